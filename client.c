@@ -6,15 +6,27 @@
  *   Initializes TCP and UDP sockets and establishes a connection to the specified server.
  *
  * - int send_udp(int fdudp, const char* message, struct addrinfo *resudp, char *buffer):
- *   Sends a message to the server using UDP and receives the response.
+ *   Sends a message to the server using UDP and receives the response, retransmitting with
+ *   an adaptive timeout (SRTT/RTTVAR estimate, exponential backoff with jitter) and giving up
+ *   after a configurable number of attempts.
  *
- * - int send_tcp(int fdtcp, const char* message, struct addrinfo *restcp, char *buffer):
- *   Sends a message to the server using TCP and receives the response.
+ * - void udp_print_stats(void):
+ *   Prints the retransmission statistics and the current RTT estimate.
+ *
+ * - int send_tcp(int fdtcp, const char* message, struct addrinfo *restcp, TcpReply *reply):
+ *   Sends a message to the server using TCP and parses the response header.
+ *
+ * - int recv_tcp_body(int* fdtcp, TcpReply *reply, FILE *file):
+ *   Streams exactly Fsize bytes of the response body to stdout and to a file, in chunks.
+ *
+ * - void tcp_set_keep_alive(int on):
+ *   Asks the server (KAL) to keep one TCP connection open for all the STR/SSB requests.
  *
  * - void close_connection(int fdudp, int fdtcp, struct addrinfo *restcp, struct addrinfo *resudp):
  *   Closes the TCP and UDP sockets and frees associated resources.
  */
 
+#include <time.h>
 #include "client.h"
 
 int initialize_sockets(int* fdtcp, int* fdudp, struct addrinfo **restcp, struct addrinfo **resudp, char* gs_ip, char* gs_port) {
@@ -40,80 +52,314 @@ int initialize_sockets(int* fdtcp, int* fdudp, struct addrinfo **restcp, struct
     errcode = getaddrinfo(gs_ip, gs_port, &hints, resudp);
     if (errcode == -1) return -1;
 
+    srand(time(NULL) ^ getpid());  // Retransmission jitter must differ between clients
     return 0;
 }
 
+// Retransmission state shared by every UDP request of this client
+static UdpStats udp_stats = {0, 0, 0, 0, 0, 0, RTO_INITIAL_US, 0};
+static int udp_max_attempts = UDP_MAX_ATTEMPTS;
+
+void udp_set_max_attempts(int attempts) {
+    if (attempts > 0) udp_max_attempts = attempts;
+}
+
+const UdpStats *udp_get_stats(void) {
+    return &udp_stats;
+}
+
+void udp_print_stats(void) {
+    printf("UDP: %ld requests, %ld retransmissions, %ld failed, %ld stray replies ignored\n",
+           udp_stats.requests, udp_stats.retransmits, udp_stats.failures, udp_stats.ignored);
+    if (udp_stats.samples > 0)
+        printf("UDP: srtt %.1f ms, rttvar %.1f ms, rto %.1f ms (%ld samples)\n",
+               udp_stats.srtt_us / 1000.0, udp_stats.rttvar_us / 1000.0, udp_stats.rto_us / 1000.0, udp_stats.samples);
+}
+
+static long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+// Fold an RTT sample into SRTT/RTTVAR and recompute the RTO (RFC 6298, alpha 1/8, beta 1/4)
+static void rtt_sample(long rtt) {
+    if (udp_stats.samples++ == 0) {
+        udp_stats.srtt_us = rtt;
+        udp_stats.rttvar_us = rtt / 2;
+    } else {
+        long err = rtt - udp_stats.srtt_us;
+        udp_stats.srtt_us += err / 8;
+        udp_stats.rttvar_us += ((err < 0 ? -err : err) - udp_stats.rttvar_us) / 4;
+    }
+    long rto = udp_stats.srtt_us + 4 * udp_stats.rttvar_us;
+    if (rto < RTO_MIN_US) rto = RTO_MIN_US;
+    if (rto > RTO_MAX_US) rto = RTO_MAX_US;
+    udp_stats.rto_us = rto;
+}
+
+// Timeout for an attempt: the current RTO plus, on retransmissions, up to 25% random
+// jitter so clients that lost packets at the same moment do not resend in lockstep
+static long attempt_timeout(int attempt) {
+    long timeout = udp_stats.rto_us;
+    if (attempt > 0) timeout += rand() % (timeout / 4 + 1);
+    return timeout;
+}
+
+// Exponential backoff after a timeout; the doubled RTO is kept for later requests until a
+// fresh RTT sample replaces it (Karn's algorithm)
+static void rto_backoff(void) {
+    udp_stats.rto_us *= 2;
+    if (udp_stats.rto_us > RTO_MAX_US) udp_stats.rto_us = RTO_MAX_US;
+}
+
+// Whether a datagram is the reply to this request: it must come from the server, carry the
+// reply code of the request and, for TRY, the trial number we sent (or be a bare "ERR")
+static int reply_matches(const char *message, const char *reply, const struct sockaddr_in *from,
+                         const struct addrinfo *resudp) {
+    static const char *codes[][2] = { {"SNG", "RSG"}, {"TRY", "RTR"}, {"QUT", "RQT"}, {"DBG", "RDB"} };
+    const struct sockaddr_in *server = (const struct sockaddr_in *) resudp->ai_addr;
+
+    if (from->sin_addr.s_addr != server->sin_addr.s_addr || from->sin_port != server->sin_port) return 0;
+    if (strncmp(reply, "ERR", 3) == 0) return 1;
+
+    for (size_t i = 0; i < sizeof(codes) / sizeof(codes[0]); i++) {
+        if (strncmp(message, codes[i][0], 3) != 0) continue;
+        if (strncmp(reply, codes[i][1], 3) != 0) return 0;
+        if (i == 1 && strncmp(reply + 3, " OK ", 4) == 0) {
+            int sent, got;
+            const char *last = strrchr(message, ' ');
+            if (last == NULL || sscanf(last + 1, "%d", &sent) != 1) return 1;
+            if (sscanf(reply + 7, "%d", &got) != 1) return 0;
+            return got == sent;
+        }
+        return 1;
+    }
+    return 1;
+}
+
 int send_udp(int fdudp, const char* message, struct addrinfo *resudp, char *buffer) {
     printf("Sending message to server: %s\n", message);  // Log the message being sent
-    int n, ct = 0;
+    int n;
+    long sent_at = 0;
     fd_set fds;
     struct timeval tv;
+    struct sockaddr_in from;
+    socklen_t fromlen;
+
+    udp_stats.requests++;
+    for (int attempt = 0; attempt < udp_max_attempts; attempt++) {
+        if (attempt > 0) udp_stats.retransmits++;
 
-    while (ct == 0){
         n = sendto(fdudp, message, strlen(message), 0, resudp->ai_addr, resudp->ai_addrlen);
         if (n == -1) return -1;
+        sent_at = now_us();
+        long deadline = sent_at + attempt_timeout(attempt);
 
-        FD_ZERO(&fds);
-        FD_SET(fdudp, &fds);
+        // Wait for the matching reply, dropping late replies to earlier requests
+        while (1) {
+            long left = deadline - now_us();
+            if (left <= 0) break;
 
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
+            FD_ZERO(&fds);
+            FD_SET(fdudp, &fds);
+            tv.tv_sec = left / 1000000;
+            tv.tv_usec = left % 1000000;
+
+            if (select(fdudp + 1, &fds, NULL, NULL, &tv) <= 0) break;
+
+            fromlen = sizeof(from);
+            n = recvfrom(fdudp, buffer, 255, 0, (struct sockaddr *) &from, &fromlen);
+            if (n == -1) return -1;
+            buffer[n] = '\0';  // Null-terminate the buffer
+
+            if (!reply_matches(message, buffer, &from, resudp)) {
+                udp_stats.ignored++;
+                continue;
+            }
+
+            // Karn's rule: a reply to a retransmitted request is ambiguous, so it is no sample
+            if (attempt == 0) rtt_sample(now_us() - sent_at);
+            printf("Received response from server: %s\n", buffer);
+            return 0;
+        }
+
+        rto_backoff();
+    }
+
+    udp_stats.failures++;
+    fprintf(stderr, "No response from server after %d attempts\n", udp_max_attempts);
+    return -1;
+}
+
+// Keep-alive TCP session: requested with tcp_set_keep_alive, granted by the server's RKA OK
+static int tcp_keep_alive = 0;
+static int tcp_connected = 0;
+
+void tcp_set_keep_alive(int on) {
+    tcp_keep_alive = on;
+}
+
+// Close the TCP session and prepare a socket for the next one
+static int reset_tcp(int *fdtcp) {
+    close(*fdtcp);
+    tcp_connected = 0;
+    *fdtcp = socket(AF_INET, SOCK_STREAM, 0);
+    return *fdtcp == -1 ? -1 : 0;
+}
 
-        ct = select(fdudp + 1, &fds, NULL, NULL, &tv);
+// A reply was fully read: keep a keep-alive session open for the next request
+static int finish_tcp(int *fdtcp) {
+    return tcp_connected ? 0 : reset_tcp(fdtcp);
+}
+
+// Read from the TCP socket into the reply buffer; returns the bytes read (0 on EOF, -1 on error)
+static int fill_reply(int fdtcp, TcpReply *reply) {
+    int n = read(fdtcp, reply->buf + reply->buf_len, sizeof(reply->buf) - reply->buf_len);
+    if (n > 0) reply->buf_len += n;
+    return n;
+}
+
+// Next space- or newline-terminated token of the header; returns -1 if the reply ends first
+static int next_token(int fdtcp, TcpReply *reply, char *token, size_t size) {
+    size_t len = 0;
+
+    while (1) {
+        while (reply->buf_off < reply->buf_len) {
+            char c = reply->buf[reply->buf_off++];
+            if (c == ' ' || c == '\n') {
+                token[len] = '\0';
+                return 0;
+            }
+            if (len + 1 < size) token[len++] = c;
+        }
+        reply->buf_off = reply->buf_len = 0;
+        if (fill_reply(fdtcp, reply) <= 0) {
+            token[len] = '\0';
+            return len > 0 ? 0 : -1;
+        }
     }
+}
 
-    n = recvfrom(fdudp, buffer, 256*sizeof(char), 0, NULL, NULL);
-    if (n == -1) return -1;
+// Connect and, if keep-alive is wanted, ask the server to keep the connection open.
+// Servers without keep-alive answer ERR and close; the client then falls back to one request per connection.
+static int open_tcp(int *fdtcp, struct addrinfo *restcp) {
+    TcpReply reply;
+    char timeout[16];
 
-    buffer[n] = '\0';  // Null-terminate the buffer
-    printf("Received response from server: %s\n", buffer);
+    if (connect(*fdtcp, restcp->ai_addr, restcp->ai_addrlen) == -1) return -1;
+    if (!tcp_keep_alive) return 0;
 
+    memset(&reply, 0, sizeof(reply));
+    if (write(*fdtcp, "KAL\n", 4) != 4) return -1;
+    if (next_token(*fdtcp, &reply, reply.code, sizeof(reply.code)) == -1 ||
+        next_token(*fdtcp, &reply, reply.status, sizeof(reply.status)) == -1 ||
+        strcmp(reply.code, "RKA") != 0 || strcmp(reply.status, "OK") != 0 ||
+        next_token(*fdtcp, &reply, timeout, sizeof(timeout)) == -1) {
+        tcp_keep_alive = 0;
+        if (reset_tcp(fdtcp) == -1) return -1;
+        return connect(*fdtcp, restcp->ai_addr, restcp->ai_addrlen);
+    }
+    tcp_connected = 1;
     return 0;
 }
 
-int send_tcp(int *fdtcp, const char* message, struct addrinfo *restcp, char *buffer) {
+// Send a request; returns -1 if the connection failed
+static int write_request(int fdtcp, const char *message) {
     int n, ct = 0;
     fd_set fds;
     struct timeval tv;
-    size_t total_read = 0;
-    size_t buffer_size = 4096;
 
-    if (connect(*fdtcp, restcp->ai_addr, restcp->ai_addrlen) == -1) {
-        return -1;
-    }
+    // Keep-alive requests are newline-framed and sent once: a resend would be pipelined as a new request
+    if (tcp_connected) return write(fdtcp, message, strlen(message)) == -1 ? -1 : 0;
 
     while (ct == 0) {
-        n = write(*fdtcp, message, strlen(message) + 1);
+        n = write(fdtcp, message, strlen(message) + 1);
         if (n == -1) {
             return -1;
         }
         FD_ZERO(&fds);
-        FD_SET(*fdtcp, &fds);
+        FD_SET(fdtcp, &fds);
 
         tv.tv_sec = 1;
         tv.tv_usec = 0;
 
-        ct = select(*fdtcp + 1, &fds, NULL, NULL, &tv);
+        ct = select(fdtcp + 1, &fds, NULL, NULL, &tv);
     }
+    return 0;
+}
+
+int send_tcp(int *fdtcp, const char* message, struct addrinfo *restcp, TcpReply *reply) {
+    char path[sizeof(reply->fname)], size[16];
+
+    for (int attempt = 0; ; attempt++) {
+        int reused = tcp_connected;
+
+        memset(reply, 0, sizeof(*reply));
+        reply->fsize = -1;
 
-    while ((n = read(*fdtcp, buffer + total_read, buffer_size - total_read)) > 0) {
-        total_read += n;
+        if (!tcp_connected && open_tcp(fdtcp, restcp) == -1) {
+            return -1;
+        }
+
+        // Parse the header only: the body is left on the socket for recv_tcp_body
+        if (write_request(*fdtcp, message) == 0 &&
+            next_token(*fdtcp, reply, reply->code, sizeof(reply->code)) == 0 &&
+            next_token(*fdtcp, reply, reply->status, sizeof(reply->status)) == 0) {
+            break;
+        }
+
+        // The server may have closed a kept-alive session while it was idle: retry once on a new one
+        reset_tcp(fdtcp);
+        if (!reused || attempt > 0) return -1;
     }
-    if (n == -1) {
-        return -1;
+
+    if (strcmp(reply->status, "ACT") != 0 && strcmp(reply->status, "FIN") != 0 && strcmp(reply->status, "OK") != 0) {
+        return finish_tcp(fdtcp);   // No file in this reply
     }
 
-    buffer[total_read] = '\0';  // Null-terminate the buffer
+    if (next_token(*fdtcp, reply, path, sizeof(path)) == -1 || next_token(*fdtcp, reply, size, sizeof(size)) == -1) {
+        reset_tcp(fdtcp);
+        return -1;
+    }
+    reply->fsize = strtol(size, NULL, 10);
 
-    close(*fdtcp);
-    *fdtcp = socket(AF_INET, SOCK_STREAM, 0);
-    if (*fdtcp == -1) {
+    // Save the file locally under its base name, never under a path chosen by the server
+    const char *base = strrchr(path, '/');
+    snprintf(reply->fname, sizeof(reply->fname), "%s", base ? base + 1 : path);
+    if (reply->fsize < 0 || reply->fname[0] == '\0' || reply->fname[0] == '.') {
+        reset_tcp(fdtcp);
         return -1;
     }
 
     return 0;
 }
 
+int recv_tcp_body(int *fdtcp, TcpReply *reply, FILE *file) {
+    long remaining = reply->fsize;
+
+    while (remaining > 0) {
+        if (reply->buf_off == reply->buf_len) {
+            reply->buf_off = reply->buf_len = 0;
+            int n = fill_reply(*fdtcp, reply);
+            if (n <= 0) break;  // Connection closed before Fsize bytes
+        }
+
+        int chunk = reply->buf_len - reply->buf_off;
+        if (chunk > remaining) chunk = remaining;
+        if (write(1, reply->buf + reply->buf_off, chunk) == -1) break;
+        if (file) fwrite(reply->buf + reply->buf_off, 1, chunk, file);
+        reply->buf_off += chunk;
+        remaining -= chunk;
+    }
+
+    if (remaining > 0) {
+        reset_tcp(fdtcp);
+        return -1;
+    }
+    return finish_tcp(fdtcp);
+}
+
 void close_connection(int fdudp, int fdtcp, struct addrinfo *restcp, struct addrinfo *resudp) {
     freeaddrinfo(restcp);
     close(fdtcp);
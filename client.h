@@ -13,10 +13,41 @@
 #include <netdb.h>
 
 #define PORT "58053"
+#define TCP_CHUNK 4096      // Read size when streaming a TCP reply body
+
+#define UDP_MAX_ATTEMPTS 6          // Default sends of a UDP request before giving up
+#define RTO_INITIAL_US 1000000L     // Retransmission timeout before the first RTT sample
+#define RTO_MIN_US 200000L
+#define RTO_MAX_US 8000000L         // Cap for the backed-off timeout
+
+// UDP retransmission statistics and RTT estimate (microseconds)
+typedef struct {
+    long requests;          // Requests sent by send_udp
+    long retransmits;       // Sends after the first one
+    long failures;          // Requests abandoned after the last attempt
+    long ignored;           // Late or mismatched replies dropped
+    long srtt_us, rttvar_us, rto_us;
+    long samples;           // RTT samples taken (first attempts only)
+} UdpStats;
+
+// Header of a TCP reply ("<code> <status> [<Fname> <Fsize> ]") and the body bytes read with it
+typedef struct {
+    char code[4];           // RST or RSS
+    char status[6];         // ACT, FIN, OK, NOK, EMPTY or ERR
+    char fname[64];         // File name of the body (without any directory)
+    long fsize;             // Body size, -1 if the reply carries no file
+    char buf[TCP_CHUNK];    // Bytes received past the header
+    int buf_off, buf_len;
+} TcpReply;
 
 int initialize_sockets(int* fdtcp, int* fdudp, struct addrinfo **restcp, struct addrinfo **resudp, char* gs_ip, char* gs_port);
 int send_udp(int fdudp, const char* message, struct addrinfo *resudp, char *buffer);
-int send_tcp(int* fdtcp, const char* message, struct addrinfo *restcp, char *buffer);
+void udp_set_max_attempts(int attempts);
+const UdpStats *udp_get_stats(void);
+void udp_print_stats(void);
+int send_tcp(int* fdtcp, const char* message, struct addrinfo *restcp, TcpReply *reply);
+int recv_tcp_body(int* fdtcp, TcpReply *reply, FILE *file);
+void tcp_set_keep_alive(int on);
 void close_connection(int fdudp, int fdtcp, struct addrinfo *restcp, struct addrinfo *resudp);
 
 #endif
\ No newline at end of file
@@ -19,7 +19,7 @@
 #include "client.h"       
 #include "command_handlers.h"
 
-int handle_start(int fdudp, struct addrinfo *resudp, char *plid, int max_playtime) {
+int handle_start(int fdudp, struct addrinfo *resudp, char *plid, int max_playtime, int pegs, int colors) {
     char message[256];
     char buffer[256];
 
@@ -29,8 +29,9 @@ int handle_start(int fdudp, struct addrinfo *resudp, char *plid, int max_playtim
     }
 
 
-    // Format the SNG request message
-    snprintf(message, sizeof(message), "SNG %s %03d\n", plid, max_playtime);
+    // Format the SNG request message (the shape is only sent for other games than 4 x 6)
+    if (pegs > 0) snprintf(message, sizeof(message), "SNG %s %03d %d %d\n", plid, max_playtime, pegs, colors);
+    else snprintf(message, sizeof(message), "SNG %s %03d\n", plid, max_playtime);
     
     if (send_udp(fdudp, message, resudp, buffer) == -1) {
         printf("Error: Failed to send start command\n");
@@ -40,7 +41,8 @@ int handle_start(int fdudp, struct addrinfo *resudp, char *plid, int max_playtim
     // Check the response from the Game Server
     if (strncmp(buffer, "RSG", 3) == 0 && strncmp(buffer + 4, "OK", 2) == 0) {
         // The response starts with "RSG OK", so the game has started successfully
-        printf("New game started (max %d sec)\n", max_playtime);
+        if (pegs > 0) printf("New game started (max %d sec, %d pegs, %d colours)\n", max_playtime, pegs, colors);
+        else printf("New game started (max %d sec)\n", max_playtime);
         return 0;
     } 
     if(strncmp(buffer, "RSG", 3) == 0 && strncmp(buffer + 4, "NOK", 3) == 0) {
@@ -50,7 +52,7 @@ int handle_start(int fdudp, struct addrinfo *resudp, char *plid, int max_playtim
     } 
     if(strncmp(buffer, "RSG", 3) == 0 && strncmp(buffer + 4, "ERR", 3) == 0) {
         // If the response is "RSG ERR", there is something wrong with the given parameters
-        printf("Error: Invalid Input\n");
+        printf("Error: Invalid Input (shapes: 4 6, 5 8, 6 10)\n");
         return -1;
     }
     // Unexpected response from the server
@@ -58,7 +60,7 @@ int handle_start(int fdudp, struct addrinfo *resudp, char *plid, int max_playtim
     return -1;
 }
 
-int handle_try(int fdudp, struct addrinfo *resudp, char *guess, int nT, char *plid) { // TODO add return values for error handling!
+int handle_try(int fdudp, struct addrinfo *resudp, char *guess, int nT, char *plid, int pegs) { // TODO add return values for error handling!
     char message[256];
     char buffer[256];
 
@@ -75,11 +77,10 @@ int handle_try(int fdudp, struct addrinfo *resudp, char *guess, int nT, char *pl
 
         // The response starts with "RTR OK", so the guess was correctly received
         if (sscanf(buffer + 7, "%d %d %d", &nTn, &nB, &nW) == 3) { 
-            if (nB == 4) {
+            if (nB == pegs) {
                 printf("Game Won!!\n");
                 return 1;
             } 
-            if (nTn == nT - 1) send_udp(fdudp, message, resudp, buffer); // Resend (might be wrong) FIXME
             printf("Correct guesses in color and position (nB): %d\n", nB);
             printf("Correct colors in incorrect positions (nW): %d\n", nW);
             return 0;
@@ -121,34 +122,35 @@ int handle_try(int fdudp, struct addrinfo *resudp, char *guess, int nT, char *pl
 
 void handle_show_trials(int fdtcp, struct addrinfo *restcp, char* plid) { // TODO finish - output to text file, format for terminal output
     char message[256];
-    char buffer[4096];
-    char fname[25];
-    char fsize[5];
+    TcpReply reply;
 
     snprintf(message, sizeof(message), "STR %s\n", plid);
 
-    if (send_tcp(&fdtcp, message, restcp, buffer) == -1) {
+    if (send_tcp(&fdtcp, message, restcp, &reply) == -1) {
         printf("Error: Failed to fetch trials\n");
         return;
-    } else if (strncmp(buffer, "RST", 3) == 0 && (strncmp(buffer + 4, "ACT", 3) == 0 || strncmp(buffer + 4, "FIN", 3) == 0)) {
-        if (strncmp(buffer + 4, "ACT", 3) == 0) {
+    } else if (strcmp(reply.code, "RST") == 0 && (strcmp(reply.status, "ACT") == 0 || strcmp(reply.status, "FIN") == 0)) {
+        if (strcmp(reply.status, "ACT") == 0) {
             printf("Current game:\n");
         } else {
             printf("Last game:\n");
         }
-        sscanf(buffer + 8, "%s %s", fname, fsize);
-        FILE *file = fopen(fname, "w");
+        fflush(stdout);
+        FILE *file = fopen(reply.fname, "w");
         if (file == NULL) {
-            printf("Error: Could not open file %s for writing\n", fname);
-            return;
+            printf("Error: Could not open file %s for writing\n", reply.fname);
         }
-        write(1, buffer + strlen(fname) + strlen(fsize) + 10, atoi(fsize));
-        fwrite(buffer + strlen(fname) + strlen(fsize) + 10, 1, atoi(fsize), file);
+        int ret = recv_tcp_body(&fdtcp, &reply, file);
+        if (file == NULL) return;
         fclose(file);
-        printf("Trials saved to %s\n", fname);
-    } else if (strncmp(buffer, "RST", 3) == 0 && strncmp(buffer + 4, "NOK", 3) == 0) {
+        if (ret == -1) {
+            printf("Error: Trials truncated (connection closed early)\n");
+            return;
+        }
+        printf("Trials saved to %s\n", reply.fname);
+    } else if (strcmp(reply.code, "RST") == 0 && strcmp(reply.status, "NOK") == 0) {
         printf("Error: No game history\n");
-    } else if (strncmp(buffer, "RST", 3) == 0 && strncmp(buffer + 4, "ERR", 3) == 0) {
+    } else if (strcmp(reply.code, "RST") == 0 && strcmp(reply.status, "ERR") == 0) {
         printf("Error: Server error\n");
     } else {
         printf("Error: Unexpected response from the server\n");
@@ -157,26 +159,27 @@ void handle_show_trials(int fdtcp, struct addrinfo *restcp, char* plid) { // TOD
 
 void handle_scoreboard(int fdtcp, struct addrinfo *restcp) { // TODO finish - idek figure it out later
     char message[] = "SSB\n";
-    char buffer[4096];
-    char fname[25];
-    char fsize[5];
+    TcpReply reply;
 
-    if (send_tcp(&fdtcp, message, restcp, buffer) == -1) {
+    if (send_tcp(&fdtcp, message, restcp, &reply) == -1) {
         printf("Error: Failed to fetch scoreboard\n");
         return;
-    } else if (strncmp(buffer, "RSS", 3) == 0 && strncmp(buffer + 4, "OK", 2) == 0) {
-        sscanf(buffer + 7, "%s %s", fname, fsize);
-        FILE *file = fopen(fname, "w");
+    } else if (strcmp(reply.code, "RSS") == 0 && strcmp(reply.status, "OK") == 0) {
+        fflush(stdout);
+        FILE *file = fopen(reply.fname, "w");
         if (file == NULL) {
-            printf("Error: Could not open file %s for writing\n", fname);
-            return;
+            printf("Error: Could not open file %s for writing\n", reply.fname);
         }
-        write(1, buffer + strlen(fname) + strlen(fsize) + 10, atoi(fsize));
-        fwrite(buffer + strlen(fname) + strlen(fsize) + 10, 1, atoi(fsize), file);
+        int ret = recv_tcp_body(&fdtcp, &reply, file);
+        if (file == NULL) return;
         fclose(file);
-        printf("Scoreboard saved to %s\n", fname);
+        if (ret == -1) {
+            printf("Error: Scoreboard truncated (connection closed early)\n");
+            return;
+        }
+        printf("Scoreboard saved to %s\n", reply.fname);
 
-    } else if (strncmp(buffer, "RSS", 3) == 0 && strncmp(buffer + 4, "EMPTY", 5) == 0) {
+    } else if (strcmp(reply.code, "RSS") == 0 && strcmp(reply.status, "EMPTY") == 0) {
         printf("Error: No scoreboard available\n");
     } else {
         printf("Error: Unexpected response from the server\n");
@@ -4,6 +4,8 @@
 #include <netdb.h>  // For struct addrinfo
 
 #define MAX_PLAYTIME 600
+#define DEFAULT_PEGS 4      // Classic game: 4 pegs, 6 colours
+#define MAX_PEGS 6          // Largest game shape the server offers (6 pegs, 10 colours)
 
 /**
  * Handle the "start" command.
@@ -14,10 +16,12 @@
  * @param resudp       Address info for the UDP socket
  * @param plid         Player ID (6-digit student number)
  * @param max_playtime Maximum time in seconds to complete the game (cannot exceed 600 seconds)
+ * @param pegs         Pegs of the secret key (0 for the classic 4 x 6 game)
+ * @param colors       Number of colours (ignored if pegs is 0)
  * 
  * @return 0 if the game has started successfully, -1 otherwise
  */
-int handle_start(int fdudp, struct addrinfo *resudp, char *plid, int max_playtime);
+int handle_start(int fdudp, struct addrinfo *resudp, char *plid, int max_playtime, int pegs, int colors);
 
 /**
  * Handle the "try" command.
@@ -26,13 +30,14 @@ int handle_start(int fdudp, struct addrinfo *resudp, char *plid, int max_playtim
  * 
  * @param fdudp  UDP socket file descriptor
  * @param resudp Address info for the UDP socket
- * @param guess  The player's guess for the secret key (format: C1 C2 C3 C4)
+ * @param guess  The player's guess for the secret key (format: C1 C2 ... Cn)
  * @param nT     Number of trial
  * @param plid   Player ID (6-digit student number)
+ * @param pegs   Pegs of the game's secret key (the game is won when they are all right)
  * 
  * @return 0 if the guess was correctly received, 1 if the game has ended, -1 if error occurred
  */
-int handle_try(int fdudp, struct addrinfo *resudp, char *guess, int nT, char *plid);
+int handle_try(int fdudp, struct addrinfo *resudp, char *guess, int nT, char *plid, int pegs);
 
 /**
  * Handle the "show_trials" command.
@@ -82,7 +87,8 @@ void handle_exit(int fdudp, struct addrinfo *resudp, char *plid);
  * @param resudp       Address info for the UDP socket
  * @param plid         Player ID (6-digit student number)
  * @param max_playtime Maximum time in seconds to complete the game (cannot exceed 600 seconds)
- * @param key          Predefined secret key for the debug mode (format: C1 C2 C3 C4)
+ * @param key          Predefined secret key for the debug mode (format: C1 C2 ... Cn; its
+ *                     number of colours selects the game shape)
  */
 int handle_debug(int fdudp, struct addrinfo *resudp, char *plid, int max_playtime, char *key);
 
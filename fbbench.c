@@ -0,0 +1,149 @@
+/*
+ * fbbench.c
+ *
+ * Microbenchmark of TRY scoring for the classic 4 x 6 shape (feedback.c). It compares the
+ * nested colour loops the server used to run on the guess and secret strings with what
+ * process_guess does now: encode the guess with code_index and look its (nB, nW) up in the
+ * precomputed 1296 x 1296 table. The 4 x 6 kernel that fills the table is timed too.
+ *
+ * It first checks the table against the loops for all 1296 x 1296 pairs, then scores the
+ * same N random (secret, guess) pairs with each method and prints the rate of each one.
+ *
+ * Usage: fbbench [-n pairs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "feedback.h"
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *phase, long ops, double seconds) {
+    printf("%-8s %10ld ops %8.1f ms %10.2f Mops/s %8.1f ns/op\n",
+           phase, ops, seconds * 1e3, ops / seconds / 1e6, seconds * 1e9 / ops);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-n pairs (1-100000000)]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+// Scoring of the server before the table: validate the guess colours, count the black pegs
+// and the unmatched colours of the secret, then match the guess's other pegs against them
+static int score_loops(const char *secret, const char *guess, int *nB, int *nW) {
+    const char classic[] = "RGBYOP";
+    int color_counts[6] = {0};
+
+    *nB = *nW = 0;
+    for (int i = 0; i < 4; i++) {
+        if (!strchr(classic, guess[i])) return -1;
+    }
+    for (int j = 0; j < 4; j++) {
+        if (guess[j] == secret[j]) {
+            (*nB)++;
+        } else {
+            for (int k = 0; k < 6; k++) {
+                if (secret[j] == classic[k]) {
+                    color_counts[k]++;
+                    break;
+                }
+            }
+        }
+    }
+    for (int j = 0; j < 4; j++) {
+        if (guess[j] != secret[j]) {
+            for (int k = 0; k < 6; k++) {
+                if (guess[j] == classic[k] && color_counts[k] > 0) {
+                    (*nW)++;
+                    color_counts[k]--;
+                    break;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int n_pairs = 10000000, opt;
+    unsigned int seed = 1;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n': n_pairs = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (n_pairs < 1 || n_pairs > 100000000) usage(argv[0]);
+
+    double t0 = now_s();
+    feedback_init();
+    report("init", (long)N_CODES * N_CODES, now_s() - t0);
+
+    // Every pair must score the same both ways
+    char codes[N_CODES][N_PEGS + 1];
+    for (int i = 0; i < N_CODES; i++) code_colors(SHAPE_4X6, i, codes[i]);
+    long mismatches = 0;
+    for (int s = 0; s < N_CODES; s++) {
+        for (int g = 0; g < N_CODES; g++) {
+            int nB, nW;
+            score_loops(codes[s], codes[g], &nB, &nW);
+            uint8_t result = feedback(s, g);
+            mismatches += FEEDBACK_NB(result) != nB || FEEDBACK_NW(result) != nW;
+        }
+    }
+    if (mismatches) {
+        fprintf(stderr, "%ld pairs score differently with the table\n", mismatches);
+        exit(EXIT_FAILURE);
+    }
+
+    // The same random pairs for every method: secrets as the Game record keeps them (an index
+    // for the table, its colours for the loops), guesses as the request carries them
+    uint16_t *secrets = malloc((size_t)n_pairs * sizeof(uint16_t));
+    uint16_t *guesses = malloc((size_t)n_pairs * sizeof(uint16_t));
+    if (!secrets || !guesses) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < n_pairs; i++) {
+        secrets[i] = rand_r(&seed) % N_CODES;
+        guesses[i] = rand_r(&seed) % N_CODES;
+    }
+
+    // Old TRY path: colour checks and nested loops over the strings
+    uint32_t checksum_loops = 0;
+    t0 = now_s();
+    for (int i = 0; i < n_pairs; i++) {
+        int nB, nW;
+        if (score_loops(codes[secrets[i]], codes[guesses[i]], &nB, &nW) == 0) checksum_loops += (nB << 4) | nW;
+    }
+    report("loops", n_pairs, now_s() - t0);
+
+    // Current TRY path: encode the guess, one table load
+    uint32_t checksum_table = 0;
+    t0 = now_s();
+    for (int i = 0; i < n_pairs; i++) {
+        int guess = code_index(SHAPE_4X6, codes[guesses[i]]);
+        if (guess >= 0) checksum_table += feedback(secrets[i], guess);
+    }
+    report("table", n_pairs, now_s() - t0);
+
+    // The kernel the table is built from, on the already encoded codes
+    uint32_t checksum_kernel = 0;
+    t0 = now_s();
+    for (int i = 0; i < n_pairs; i++) checksum_kernel += game_shapes[SHAPE_4X6].score(secrets[i], guesses[i]);
+    report("kernel", n_pairs, now_s() - t0);
+
+    printf("(all %d pairs agree, checksums %u %u %u)\n", N_CODES * N_CODES, checksum_loops, checksum_table, checksum_kernel);
+    free(secrets);
+    free(guesses);
+    return checksum_loops == checksum_table && checksum_table == checksum_kernel ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,112 @@
+/*
+ * feedback.c
+ *
+ * Mastermind scoring. A game has one of a few shapes (pegs x colours), each with its own
+ * scoring kernel stamped out by DEFINE_SCORE_KERNEL, so the loops have constant bounds and
+ * constant divisors. A kernel spreads the colour digits and per-colour histograms of both codes
+ * over 16-byte vectors (GCC vector extensions, SSE2/NEON when optimized): black pegs are one
+ * lane-wise compare of the digits, and the colours in common one lane-wise minimum of the
+ * histograms.
+ *
+ * The classic 4 x 6 shape has only 6^4 = 1296 codes, so the black/white peg counts of every
+ * (secret, guess) pair are computed once at startup into a 1296 x 1296 table (one byte per
+ * entry, ~1.6 MB), and scoring one of its TRYs stays a single table load.
+ */
+
+#include <string.h>
+
+#include "feedback.h"
+
+const char colors[] = "RGBYOPWKCM";
+
+// Zero-initialized entries are "not a colour", so the table is stored offset by one
+const uint8_t color_code[256] = {
+    ['R'] = 1, ['G'] = 2, ['B'] = 3, ['Y'] = 4, ['O'] = 5, ['P'] = 6,
+    ['W'] = 7, ['K'] = 8, ['C'] = 9, ['M'] = 10
+};
+
+uint8_t feedback_table[N_CODES * N_CODES];
+
+typedef uint8_t lanes __attribute__((vector_size(16)));
+
+// Sum of the 16 lanes (each small enough that no partial sum overflows a byte)
+static inline int sum_lanes(lanes v) {
+    uint64_t halves[2];
+    memcpy(halves, &v, sizeof(halves));
+    uint64_t x = halves[0] + halves[1];
+    x += x >> 32;
+    x += x >> 16;
+    x += x >> 8;
+    return (int)(x & 0xFF);
+}
+
+/*
+ * Kernel of a P x C shape. Unused digit lanes hold different fillers in the two codes so they
+ * never match; unused histogram lanes are zero in both.
+ */
+#define DEFINE_SCORE_KERNEL(P, C) \
+    static uint8_t score_##P##x##C(uint32_t secret, uint32_t guess) { \
+        lanes s = ~(lanes){0}, g = s - 1, hs = {0}, hg = {0}; \
+        for (int i = 0; i < (P); i++) { \
+            s[i] = secret % (C); \
+            g[i] = guess % (C); \
+            hs[s[i]]++; \
+            hg[g[i]]++; \
+            secret /= (C); \
+            guess /= (C); \
+        } \
+        lanes fewer = (lanes)(hs < hg); \
+        int nB = sum_lanes((lanes)(s == g) & 1); \
+        int nW = sum_lanes((hs & fewer) | (hg & ~fewer)) - nB; \
+        return (uint8_t)((nB << 4) | nW); \
+    }
+
+DEFINE_SCORE_KERNEL(4, 6)
+DEFINE_SCORE_KERNEL(5, 8)
+DEFINE_SCORE_KERNEL(6, 10)
+
+const GameShape game_shapes[N_SHAPES] = {
+    [SHAPE_4X6] = {4, 6, 1296, score_4x6},
+    [SHAPE_5X8] = {5, 8, 32768, score_5x8},
+    [SHAPE_6X10] = {6, 10, 1000000, score_6x10},
+};
+
+int find_shape(int pegs, int n_colors) {
+    for (int shape = 0; shape < N_SHAPES; shape++) {
+        if (game_shapes[shape].pegs == pegs && game_shapes[shape].colors == n_colors) return shape;
+    }
+    return -1;
+}
+
+int shape_of_pegs(int pegs) {
+    for (int shape = 0; shape < N_SHAPES; shape++) {
+        if (game_shapes[shape].pegs == pegs) return shape;
+    }
+    return -1;
+}
+
+int code_index(int shape, const char *code) {
+    const GameShape *s = &game_shapes[shape];
+    int index = 0;
+    for (int i = 0; i < s->pegs; i++) {
+        int digit = color_digit(code[i]);
+        if (digit < 0 || digit >= s->colors) return -1;
+        index = index * s->colors + digit;
+    }
+    return index;
+}
+
+void code_colors(int shape, uint32_t index, char *code) {
+    const GameShape *s = &game_shapes[shape];
+    for (int i = s->pegs - 1; i >= 0; i--) {
+        code[i] = colors[index % s->colors];
+        index /= s->colors;
+    }
+    code[s->pegs] = '\0';
+}
+
+void feedback_init(void) {
+    for (int secret = 0; secret < N_CODES; secret++)
+        for (int guess = 0; guess < N_CODES; guess++)
+            feedback_table[secret * N_CODES + guess] = score_4x6(secret, guess);
+}
@@ -0,0 +1,87 @@
+#ifndef FEEDBACK_H
+#define FEEDBACK_H
+
+#include <stdint.h>
+
+// Classic game: 4 pegs, 6 colours, scored from a precomputed table
+#define N_PEGS 4
+#define N_COLORS 6
+#define N_CODES 1296            // N_COLORS ^ N_PEGS
+
+// Largest shape (see game_shapes)
+#define MAX_PEGS 6
+#define MAX_COLORS 10
+
+// A feedback byte packs nB in the high nibble and nW in the low nibble
+#define FEEDBACK_NB(f) ((f) >> 4)
+#define FEEDBACK_NW(f) ((f) & 0x0F)
+
+// Supported game shapes; a shape is identified by its number of pegs
+enum {
+    SHAPE_4X6,                  // Classic (default of SNG)
+    SHAPE_5X8,
+    SHAPE_6X10,
+    N_SHAPES
+};
+
+typedef struct {
+    int pegs;
+    int colors;                 // The first `colors` letters of colors[]
+    uint32_t codes;             // colors ^ pegs
+    uint8_t (*score)(uint32_t secret, uint32_t guess);     // Scoring kernel of the shape
+} GameShape;
+
+extern const GameShape game_shapes[N_SHAPES];
+extern const char colors[];                 // "RGBYOPWKCM"
+extern const uint8_t color_code[256];       // Colour letter -> 1 + its digit, 0 if not a colour
+extern uint8_t feedback_table[N_CODES * N_CODES];
+
+/**
+ * Build the table of (nB, nW) for every (secret, guess) pair of the classic shape. Must be
+ * called once at startup, before any worker scores a guess.
+ */
+void feedback_init(void);
+
+/**
+ * Shape with the given numbers of pegs and colours.
+ *
+ * @return the shape, or -1 if it is not supported
+ */
+int find_shape(int pegs, int colors);
+
+/**
+ * Shape of a code with the given number of pegs.
+ *
+ * @return the shape, or -1 if no shape has that many pegs
+ */
+int shape_of_pegs(int pegs);
+
+/**
+ * Encode a code ("RGBY", "RGBYW", ...) as its index in base colours of its shape.
+ *
+ * @return the index (0 to codes - 1), or -1 if a colour is invalid for the shape
+ */
+int code_index(int shape, const char *code);
+
+/**
+ * Decode a code index into its colour letters (pegs + 1 bytes with the terminator).
+ */
+void code_colors(int shape, uint32_t index, char *code);
+
+// Digit of a colour letter (0 to MAX_COLORS - 1), or -1
+static inline int color_digit(char c) {
+    return (int)color_code[(uint8_t)c] - 1;
+}
+
+// Score a guess against a secret of the classic shape: one load from the precomputed table
+static inline uint8_t feedback(int secret, int guess) {
+    return feedback_table[secret * N_CODES + guess];
+}
+
+// Score a guess against a secret of any shape
+static inline uint8_t shape_feedback(int shape, uint32_t secret, uint32_t guess) {
+    if (shape == SHAPE_4X6) return feedback(secret, guess);
+    return game_shapes[shape].score(secret, guess);
+}
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * game_table.c
+ *
+ * Hash table of active games, one per UDP worker shard. Every lookup, insert and removal
+ * is O(1) on average: the 6-digit PLID is packed into an integer, spread with a
+ * multiplicative hash and resolved with linear probing. The table doubles when it gets
+ * 70% full, so the number of concurrent games is only limited by memory.
+ *
+ * Removals use backward-shift deletion, so the table never accumulates tombstones.
+ *
+ * Game records are split in a 16-byte hot part and a 32-byte history, in parallel arrays
+ * indexed by slot: with the buckets, a million concurrent games take about 70 MB.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "game_table.h"
+
+// Home bucket of a key
+static uint32_t bucket_of(const GameTable *table, uint32_t key) {
+    return (uint32_t)(key * 2654435761u) >> table->shift;
+}
+
+int plid_key(const char *plid) {
+    int key = 0;
+    for (int i = 0; i < 6; i++) {
+        if (plid[i] < '0' || plid[i] > '9') return -1;
+        key = key * 10 + (plid[i] - '0');
+    }
+    return plid[6] == '\0' ? key : -1;
+}
+
+void plid_string(uint32_t key, char *plid) {
+    for (int i = 5; i >= 0; i--) {
+        plid[i] = '0' + key % 10;
+        key /= 10;
+    }
+    plid[6] = '\0';
+}
+
+// Allocate an empty set of buckets
+static int alloc_buckets(GameTable *table, uint32_t capacity) {
+    uint32_t bits = 0;
+    while ((1u << bits) < capacity) bits++;
+
+    table->buckets = malloc((size_t)(1u << bits) * sizeof(GameBucket));
+    if (!table->buckets) return -1;
+    memset(table->buckets, 0xFF, (size_t)(1u << bits) * sizeof(GameBucket));  // All EMPTY_KEY
+    table->capacity = 1u << bits;
+    table->shift = 32 - bits;
+    return 0;
+}
+
+int game_table_init(GameTable *table, uint32_t capacity) {
+    memset(table, 0, sizeof(*table));
+    if (capacity < 16) capacity = 16;
+    return alloc_buckets(table, capacity);
+}
+
+void game_table_free(GameTable *table) {
+    free(table->buckets);
+    free(table->games);
+    free(table->histories);
+    free(table->free_slots);
+    memset(table, 0, sizeof(*table));
+}
+
+// Bucket holding a key, or -1
+static int64_t find_bucket(const GameTable *table, uint32_t key) {
+    uint32_t mask = table->capacity - 1;
+    for (uint32_t b = bucket_of(table, key); ; b = (b + 1) & mask) {
+        if (table->buckets[b].key == key) return b;
+        if (table->buckets[b].key == EMPTY_KEY) return -1;
+    }
+}
+
+// Place a key in its first free bucket (the key must not be present)
+static void place(GameTable *table, uint32_t key, uint32_t slot) {
+    uint32_t mask = table->capacity - 1;
+    uint32_t b = bucket_of(table, key);
+    while (table->buckets[b].key != EMPTY_KEY) b = (b + 1) & mask;
+    table->buckets[b].key = key;
+    table->buckets[b].slot = slot;
+}
+
+// Double the number of buckets and rehash every key
+static int grow_buckets(GameTable *table) {
+    GameBucket *old_buckets = table->buckets;
+    uint32_t old_capacity = table->capacity;
+
+    if (alloc_buckets(table, old_capacity * 2) < 0) {
+        table->buckets = old_buckets;
+        return -1;
+    }
+    for (uint32_t b = 0; b < old_capacity; b++) {
+        if (old_buckets[b].key != EMPTY_KEY) place(table, old_buckets[b].key, old_buckets[b].slot);
+    }
+    free(old_buckets);
+    return 0;
+}
+
+// Resize the record arrays to `new_cap` slots
+static int grow_slots(GameTable *table, uint32_t new_cap) {
+    Game *games = realloc(table->games, (size_t)new_cap * sizeof(Game));
+    if (!games) return -1;
+    table->games = games;
+    GameHistory *histories = realloc(table->histories, (size_t)new_cap * sizeof(GameHistory));
+    if (!histories) return -1;
+    table->histories = histories;
+    uint32_t *free_slots = realloc(table->free_slots, (size_t)new_cap * sizeof(uint32_t));
+    if (!free_slots) return -1;
+    table->free_slots = free_slots;
+    table->games_cap = new_cap;
+    return 0;
+}
+
+// Take a free game slot, growing the record array if all are in use
+static int64_t take_slot(GameTable *table) {
+    if (table->n_free > 0) return table->free_slots[--table->n_free];
+
+    if (table->next_slot == table->games_cap && grow_slots(table, table->games_cap ? table->games_cap * 2 : 64) < 0)
+        return -1;
+    return table->next_slot++;
+}
+
+Game *game_table_find(GameTable *table, uint32_t key) {
+    int64_t b = find_bucket(table, key);
+    return b < 0 ? NULL : &table->games[table->buckets[b].slot];
+}
+
+Game *game_table_insert(GameTable *table, uint32_t key) {
+    // Keep the load factor under 70%
+    if ((uint64_t)(table->count + 1) * 10 > (uint64_t)table->capacity * 7 && grow_buckets(table) < 0)
+        return NULL;
+
+    int64_t slot = take_slot(table);
+    if (slot < 0) return NULL;
+
+    place(table, key, (uint32_t)slot);
+    table->count++;
+    memset(&table->games[slot], 0, sizeof(Game));
+    memset(&table->histories[slot], 0, sizeof(GameHistory));
+    table->games[slot].plid = key;
+    return &table->games[slot];
+}
+
+int game_table_reserve(GameTable *table, uint32_t count) {
+    while ((uint64_t)(table->count + count) * 10 > (uint64_t)table->capacity * 7) {
+        if (grow_buckets(table) < 0) return -1;
+    }
+    uint64_t needed = (uint64_t)table->next_slot + (count > table->n_free ? count - table->n_free : 0);
+    if (needed > table->games_cap && grow_slots(table, (uint32_t)needed) < 0) return -1;
+    return 0;
+}
+
+void game_table_remove(GameTable *table, uint32_t key) {
+    uint32_t mask = table->capacity - 1;
+    int64_t found = find_bucket(table, key);
+    if (found < 0) return;
+
+    uint32_t hole = (uint32_t)found;
+    table->free_slots[table->n_free++] = table->buckets[hole].slot;
+    table->count--;
+
+    // Backward-shift deletion: pull back every following key whose probe sequence crosses the hole
+    for (uint32_t b = (hole + 1) & mask; table->buckets[b].key != EMPTY_KEY; b = (b + 1) & mask) {
+        uint32_t home = bucket_of(table, table->buckets[b].key);
+        int crosses = (hole <= b) ? (home <= hole || home > b) : (home <= hole && home > b);
+        if (crosses) {
+            table->buckets[hole] = table->buckets[b];
+            hole = b;
+        }
+    }
+    table->buckets[hole].key = EMPTY_KEY;
+}
+
+size_t game_table_bytes(const GameTable *table) {
+    return (size_t)table->capacity * sizeof(GameBucket) +
+           (size_t)table->games_cap * (sizeof(Game) + sizeof(GameHistory) + sizeof(uint32_t));
+}
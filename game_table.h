@@ -0,0 +1,138 @@
+#ifndef GAME_TABLE_H
+#define GAME_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define GAME_TABLE_INITIAL 1024     // Initial bucket count of each shard's table
+#define EMPTY_KEY 0xFFFFFFFFu       // Marks a free bucket (no 6-digit PLID packs to it)
+
+#define GAME_MAX_TRIALS 8
+#define GAME_EPOCH 1700000000       // Origin of the 32-bit game times (Nov 2023; they last until 2160)
+
+/*
+ * Hot part of a game, read by every request: 16 bytes, four to a cache line. The PLID is
+ * packed (0-999999 fits in 20 bits), codes are indices in base colours of the game's shape
+ * (see feedback.h) and times are seconds since GAME_EPOCH.
+ */
+typedef struct {
+    uint32_t plid : 20;     // Packed PLID (see plid_key)
+    uint32_t shape : 2;     // Pegs x colours of the game (SHAPE_4X6, ...)
+    uint32_t debug : 1;     // DEBUG mode: secret chosen by the player
+    uint32_t active : 1;    // Active game flag (1: active, 0: inactive)
+    uint32_t trials : 4;    // Number of trials made
+    uint32_t secret;        // Code index of the secret key
+    uint32_t start;         // Start time of the game
+    uint32_t deadline;      // start + maximum playtime
+} Game;
+
+// Cold part of a game, only read to check a TRY against the earlier guesses
+typedef struct {
+    uint32_t guesses[GAME_MAX_TRIALS];  // Code index of each trial
+} GameHistory;
+
+// A bucket holds the key and the slot together, so a probe touches a single cache line
+typedef struct {
+    uint32_t key;           // Packed PLID (EMPTY_KEY if free)
+    uint32_t slot;          // Slot in `games`
+} GameBucket;
+
+/*
+ * Open-addressing (linear probing) hash table of the games of one worker shard.
+ * Buckets map the packed PLID to a slot in `games`; a game keeps its slot for its whole
+ * life, so slot numbers can be referenced from other structures, while the buckets are
+ * rehashed as the table grows.
+ */
+typedef struct {
+    GameBucket *buckets;
+    uint32_t capacity;      // Number of buckets (power of two)
+    uint32_t shift;         // 32 - log2(capacity), for multiplicative hashing
+    uint32_t count;         // Games in the table
+
+    Game *games;            // Game records, hot part
+    GameHistory *histories; // Their cold part (same slot)
+    uint32_t games_cap;
+    uint32_t *free_slots;   // Stack of released slots
+    uint32_t n_free;
+    uint32_t next_slot;     // First never-used slot
+} GameTable;
+
+/**
+ * Pack a PLID string into an integer key.
+ *
+ * @param plid  Player ID
+ *
+ * @return the key (0-999999), or -1 if the PLID is not exactly 6 digits
+ */
+int plid_key(const char *plid);
+
+/**
+ * Unpack a PLID key into its 6-digit string (7 bytes with the terminator).
+ */
+void plid_string(uint32_t key, char *plid);
+
+int game_table_init(GameTable *table, uint32_t capacity);
+void game_table_free(GameTable *table);
+
+/**
+ * Look up the game of a player.
+ *
+ * @return the game, or NULL if the player has none. The pointer is valid until the next insert.
+ */
+Game *game_table_find(GameTable *table, uint32_t key);
+
+/**
+ * Add a game for a player that has none, growing the table if needed.
+ *
+ * @return the zeroed game record (history included) with its PLID set, or NULL if out of memory. The pointer is valid until the next insert.
+ */
+Game *game_table_insert(GameTable *table, uint32_t key);
+
+/**
+ * Make room for `count` more games, so that many inserts neither rehash nor reallocate (bulk loads:
+ * inserting keys in the bucket order of a bigger table into one that keeps doubling would pile
+ * them up in long probe runs).
+ *
+ * @return 0 on success, -1 if out of memory
+ */
+int game_table_reserve(GameTable *table, uint32_t count);
+
+/**
+ * Remove the game of a player and release its slot.
+ */
+void game_table_remove(GameTable *table, uint32_t key);
+
+/**
+ * Bytes allocated by the table (buckets, records and free-slot stack).
+ */
+size_t game_table_bytes(const GameTable *table);
+
+// Slot number of a game record (stable for the life of the game)
+static inline uint32_t game_slot(const GameTable *table, const Game *game) {
+    return (uint32_t)(game - table->games);
+}
+
+// Guesses of a game
+static inline GameHistory *game_history(const GameTable *table, const Game *game) {
+    return &table->histories[game - table->games];
+}
+
+// Conversions between time_t and the 32-bit game times
+static inline uint32_t game_time(time_t t) {
+    return (uint32_t)(t - GAME_EPOCH);
+}
+
+static inline time_t game_start(const Game *game) {
+    return GAME_EPOCH + (time_t)game->start;
+}
+
+static inline time_t game_deadline(const Game *game) {
+    return GAME_EPOCH + (time_t)game->deadline;
+}
+
+static inline int game_playtime(const Game *game) {
+    return (int)(game->deadline - game->start);
+}
+
+#endif
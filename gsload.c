@@ -0,0 +1,443 @@
+/*
+ * gsload.c
+ *
+ * Closed-loop load generator for the Game Server. One epoll-driven process simulates N players,
+ * each with its own connected UDP socket, that repeatedly:
+ *   - start a game (SNG),
+ *   - make up to -k guesses (TRY), each optionally followed by a STR and/or SSB over TCP,
+ *   - quit (QUT) unless the game already ended,
+ * waiting for every reply (and an optional think time) before the next request.
+ *
+ * At the end it prints, per command, the number of requests, errors and timeouts, the
+ * throughput and the p50/p99/p999/max latency.
+ *
+ * Usage: gsload [-n GSIP] [-p GSport] [-c players] [-d seconds] [-k tries] [-t think_ms]
+ *               [-r str_percent] [-s ssb_percent] [-b first_plid]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "histogram.h"
+
+#define PORT "58053"
+#define MAX_EVENTS 256
+#define UDP_TIMEOUT_US 1000000      // Resend an unanswered datagram after 1 s
+#define TCP_TIMEOUT_US 5000000      // Give up on a TCP request after 5 s
+#define REPLY_SIZE 4096
+
+static const char colors[] = "RGBYOP";
+
+// Commands, in report order
+enum { CMD_SNG, CMD_TRY, CMD_QUT, CMD_STR, CMD_SSB, N_CMDS };
+static const char *cmd_names[N_CMDS] = {"SNG", "TRY", "QUT", "STR", "SSB"};
+
+typedef struct {
+    Histogram latency;      // Microseconds
+    uint64_t errors;        // Unexpected replies
+    uint64_t timeouts;      // Resent datagrams / abandoned TCP requests
+} CmdStats;
+
+typedef enum {
+    P_READY,        // Decide and send the next request
+    P_UDP,          // Waiting for a UDP reply
+    P_TCP,          // Waiting for a TCP connection to complete and answer
+    P_THINK         // Idle until `deadline`
+} PlayerState;
+
+typedef struct {
+    int id;
+    char plid[7];
+    int udp_fd, tcp_fd;
+    PlayerState state;
+    int cmd;                    // Command in flight
+    char request[64];           // Request in flight (resent on timeout)
+    int request_len, sent;      // TCP: bytes of the request already written
+    char reply[REPLY_SIZE];     // TCP reply received so far
+    int reply_len;
+    uint64_t started;           // When the request was first sent (us)
+    uint64_t deadline;          // Resend / give up / wake up time (us)
+    int in_game;
+    int trial;                  // Trials made in the current game
+    int guesses[8];             // Codes already tried (indices)
+    int pending_str, pending_ssb;
+} Player;
+
+// Options
+static const char *gs_ip = "127.0.0.1";
+static const char *gs_port = PORT;
+static int n_players = 100;
+static int duration = 10;
+static int max_tries = 4;
+static int think_ms = 0;
+static int str_percent = 10;
+static int ssb_percent = 5;
+static int first_plid = 900000;
+
+static struct sockaddr_in gs_addr;
+static int epoll_fd;
+static Player *players;
+static int *ready;          // Players in P_READY, waiting for their next request
+static int n_ready = 0;
+static CmdStats stats[N_CMDS];
+static unsigned int seed = 1;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// epoll tag of a player's socket: its index, and whether it is the TCP one
+static uint64_t tag(const Player *player, int tcp) {
+    return (uint64_t)player->id << 1 | (uint64_t)tcp;
+}
+
+// Queue a player for its next request
+static void make_ready(Player *player) {
+    player->state = P_READY;
+    ready[n_ready++] = player->id;
+}
+
+static void send_udp(Player *player, int cmd, uint64_t now) {
+    player->cmd = cmd;
+    player->started = now;
+    player->deadline = now + UDP_TIMEOUT_US;
+    player->state = P_UDP;
+    if (send(player->udp_fd, player->request, player->request_len, 0) < 0 && errno != EAGAIN)
+        perror("send");
+}
+
+static void start_tcp(Player *player, int cmd, uint64_t now) {
+    player->cmd = cmd;
+    player->started = now;
+    player->deadline = now + TCP_TIMEOUT_US;
+    player->state = P_TCP;
+    player->sent = 0;
+    player->reply_len = 0;
+
+    player->tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (player->tcp_fd < 0) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    if (connect(player->tcp_fd, (struct sockaddr *)&gs_addr, sizeof(gs_addr)) < 0 && errno != EINPROGRESS) {
+        perror("connect");
+        close(player->tcp_fd);
+        player->tcp_fd = -1;
+        stats[cmd].errors++;
+        make_ready(player);
+        return;
+    }
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.u64 = tag(player, 1)};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, player->tcp_fd, &ev);
+}
+
+static void end_tcp(Player *player) {
+    if (player->tcp_fd >= 0) close(player->tcp_fd);     // Also removes it from the epoll set
+    player->tcp_fd = -1;
+}
+
+// Reply received: account for it and schedule the next request
+static void completed(Player *player, int ok, uint64_t now) {
+    hist_record(&stats[player->cmd].latency, now - player->started);
+    if (!ok) stats[player->cmd].errors++;
+
+    if (think_ms > 0) {
+        player->state = P_THINK;
+        player->deadline = now + (uint64_t)(rand_r(&seed) % (2 * think_ms * 1000 + 1));
+    } else {
+        make_ready(player);
+    }
+}
+
+// A random guess not yet made in this game
+static int new_guess(Player *player) {
+    while (1) {
+        int code = rand_r(&seed) % 1296, used = 0;
+        for (int i = 0; i < player->trial; i++) used |= player->guesses[i] == code;
+        if (!used) return code;
+    }
+}
+
+// Send the next request of a player's script
+static void next_request(Player *player, uint64_t now) {
+    if (player->pending_str) {
+        player->pending_str = 0;
+        player->request_len = snprintf(player->request, sizeof(player->request), "STR %s\n", player->plid);
+        start_tcp(player, CMD_STR, now);
+    } else if (player->pending_ssb) {
+        player->pending_ssb = 0;
+        player->request_len = snprintf(player->request, sizeof(player->request), "SSB\n");
+        start_tcp(player, CMD_SSB, now);
+    } else if (!player->in_game) {
+        player->request_len = snprintf(player->request, sizeof(player->request), "SNG %s 600\n", player->plid);
+        send_udp(player, CMD_SNG, now);
+    } else if (player->trial < max_tries) {
+        int code = new_guess(player);
+        player->guesses[player->trial] = code;
+        player->request_len = snprintf(player->request, sizeof(player->request), "TRY %s %c %c %c %c %d\n",
+                                       player->plid, colors[code / 216], colors[code / 36 % 6],
+                                       colors[code / 6 % 6], colors[code % 6], player->trial + 1);
+        send_udp(player, CMD_TRY, now);
+    } else {
+        player->request_len = snprintf(player->request, sizeof(player->request), "QUT %s\n", player->plid);
+        send_udp(player, CMD_QUT, now);
+    }
+}
+
+static void handle_udp_reply(Player *player, uint64_t now) {
+    char reply[256];
+    ssize_t n;
+
+    while ((n = recv(player->udp_fd, reply, sizeof(reply) - 1, 0)) >= 0) {
+        reply[n] = '\0';
+        if (player->state != P_UDP) continue;   // Late reply to a resent request
+
+        int ok = 1, nB;
+        switch (player->cmd) {
+            case CMD_SNG:
+                if (strncmp(reply, "RSG OK", 6) == 0) {
+                    player->in_game = 1;
+                    player->trial = 0;
+                } else if (strncmp(reply, "RSG NOK", 7) == 0) {
+                    player->in_game = 1;                // Left over from an earlier run: quit it
+                    player->trial = max_tries;
+                } else {
+                    ok = 0;
+                }
+                break;
+            case CMD_TRY:
+                if (sscanf(reply, "RTR OK %*d %d", &nB) == 1) {
+                    player->trial++;
+                    if (nB == 4) player->in_game = 0;  // Won
+                    player->pending_str = rand_r(&seed) % 100 < str_percent;
+                    player->pending_ssb = rand_r(&seed) % 100 < ssb_percent;
+                } else if (strncmp(reply, "RTR ENT", 7) == 0 || strncmp(reply, "RTR ETM", 7) == 0) {
+                    player->in_game = 0;
+                } else {
+                    ok = 0;
+                    player->in_game = 0;                // Out of step with the server: start over
+                }
+                break;
+            case CMD_QUT:
+                ok = strncmp(reply, "RQT OK", 6) == 0 || strncmp(reply, "RQT NOK", 7) == 0;
+                player->in_game = 0;
+                break;
+        }
+        completed(player, ok, now);
+    }
+}
+
+static void handle_tcp_event(Player *player, uint64_t now) {
+    if (player->state != P_TCP || player->tcp_fd < 0) return;
+
+    // Send the request once connected
+    while (player->sent < player->request_len) {
+        ssize_t n = send(player->tcp_fd, player->request + player->sent, player->request_len - player->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINPROGRESS || errno == ENOTCONN) return;
+            end_tcp(player);
+            completed(player, 0, now);
+            return;
+        }
+        player->sent += n;
+    }
+
+    // Read until the server closes the connection
+    while (1) {
+        char *dst = player->reply + player->reply_len;
+        int room = REPLY_SIZE - 1 - player->reply_len;
+        char discard[REPLY_SIZE];
+        ssize_t n = room > 0 ? recv(player->tcp_fd, dst, room, 0) : recv(player->tcp_fd, discard, sizeof(discard), 0);
+        if (n < 0) {
+            if (errno == EAGAIN) return;
+            break;
+        }
+        if (n == 0) break;
+        if (room > 0) player->reply_len += n;
+    }
+    player->reply[player->reply_len] = '\0';
+    end_tcp(player);
+
+    int ok = player->cmd == CMD_STR ? strncmp(player->reply, "RST ", 4) == 0 && strncmp(player->reply, "RST ERR", 7) != 0
+                                    : strncmp(player->reply, "RSS OK", 6) == 0 || strncmp(player->reply, "RSS EMPTY", 9) == 0;
+    completed(player, ok, now);
+}
+
+// Resend lost datagrams, abandon stuck TCP requests and wake thinking players
+static void check_deadlines(uint64_t now) {
+    for (int i = 0; i < n_players; i++) {
+        Player *player = &players[i];
+        if (player->state == P_READY || player->deadline > now) continue;
+
+        switch (player->state) {
+            case P_UDP:
+                stats[player->cmd].timeouts++;
+                player->deadline = now + UDP_TIMEOUT_US;
+                if (send(player->udp_fd, player->request, player->request_len, 0) < 0 && errno != EAGAIN)
+                    perror("send");
+                break;
+            case P_TCP:
+                stats[player->cmd].timeouts++;
+                end_tcp(player);
+                make_ready(player);
+                break;
+            case P_THINK:
+                make_ready(player);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static void print_report(double elapsed) {
+    printf("\n%d players, %.1f s, %d tries per game, think %d ms, STR %d%%, SSB %d%%\n\n",
+           n_players, elapsed, max_tries, think_ms, str_percent, ssb_percent);
+    printf("%-4s %10s %8s %8s %10s %10s %10s %10s %10s\n",
+           "cmd", "requests", "errors", "timeouts", "req/s", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+
+    Histogram all = {0};
+    uint64_t errors = 0, timeouts = 0;
+    for (int c = 0; c < N_CMDS; c++) {
+        const Histogram *h = &stats[c].latency;
+        printf("%-4s %10lu %8lu %8lu %10.0f %10lu %10lu %10lu %10lu\n", cmd_names[c],
+               h->total, stats[c].errors, stats[c].timeouts, h->total / elapsed,
+               hist_percentile(h, 50), hist_percentile(h, 99), hist_percentile(h, 99.9), h->max);
+        hist_merge(&all, h);
+        errors += stats[c].errors;
+        timeouts += stats[c].timeouts;
+    }
+    printf("%-4s %10lu %8lu %8lu %10.0f %10lu %10lu %10lu %10lu\n", "all",
+           all.total, errors, timeouts, all.total / elapsed,
+           hist_percentile(&all, 50), hist_percentile(&all, 99), hist_percentile(&all, 99.9), all.max);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-n GSIP] [-p GSport] [-c players] [-d seconds] [-k tries] [-t think_ms] "
+                    "[-r str_percent] [-s ssb_percent] [-b first_plid]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    struct epoll_event events[MAX_EVENTS];
+    struct addrinfo hints, *res;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:p:c:d:k:t:r:s:b:")) != -1) {
+        switch (opt) {
+            case 'n': gs_ip = optarg; break;
+            case 'p': gs_port = optarg; break;
+            case 'c': n_players = atoi(optarg); break;
+            case 'd': duration = atoi(optarg); break;
+            case 'k': max_tries = atoi(optarg); break;
+            case 't': think_ms = atoi(optarg); break;
+            case 'r': str_percent = atoi(optarg); break;
+            case 's': ssb_percent = atoi(optarg); break;
+            case 'b': first_plid = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (n_players < 1 || duration < 1 || max_tries < 1 || max_tries > 8 || think_ms < 0 ||
+        first_plid < 0 || first_plid + n_players > 1000000) usage(argv[0]);
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(gs_ip, gs_port, &hints, &res) != 0) {
+        fprintf(stderr, "Cannot resolve %s:%s\n", gs_ip, gs_port);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(&gs_addr, res->ai_addr, sizeof(gs_addr));
+    freeaddrinfo(res);
+
+    // Two sockets per player at most
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t)n_players * 2 + 64) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    if ((epoll_fd = epoll_create1(0)) < 0) {
+        perror("epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+
+    players = calloc(n_players, sizeof(Player));
+    ready = calloc(n_players, sizeof(int));
+    if (!players || !ready) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    seed = (unsigned int)time(NULL);
+    for (int i = 0; i < n_players; i++) {
+        Player *player = &players[i];
+        player->id = i;
+        player->tcp_fd = -1;
+        snprintf(player->plid, sizeof(player->plid), "%06d", first_plid + i);
+        player->udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (player->udp_fd < 0 || connect(player->udp_fd, (struct sockaddr *)&gs_addr, sizeof(gs_addr)) < 0) {
+            perror("UDP socket (raise the open file limit?)");
+            exit(EXIT_FAILURE);
+        }
+        struct epoll_event ev = {.events = EPOLLIN, .data.u64 = tag(player, 0)};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, player->udp_fd, &ev);
+        make_ready(player);
+    }
+
+    uint64_t start = now_us(), end = start + (uint64_t)duration * 1000000, last_check = start;
+    while (1) {
+        uint64_t now = now_us();
+        if (now >= end) break;
+
+        // next_request may make the player ready again (failed connect), so take the list first
+        int n_batch = n_ready;
+        n_ready = 0;
+        for (int i = 0; i < n_batch; i++) next_request(&players[ready[i]], now);
+
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, 1);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        now = now_us();
+        for (int i = 0; i < n; i++) {
+            Player *player = &players[events[i].data.u64 >> 1];
+            if (events[i].data.u64 & 1) handle_tcp_event(player, now);
+            else handle_udp_reply(player, now);
+        }
+        if (now - last_check >= 1000) {
+            check_deadlines(now);
+            last_check = now;
+        }
+    }
+    double elapsed = (now_us() - start) / 1e6;
+
+    // Leave no games behind
+    for (int i = 0; i < n_players; i++) {
+        char quit[16];
+        int len = snprintf(quit, sizeof(quit), "QUT %s\n", players[i].plid);
+        if (players[i].in_game) send(players[i].udp_fd, quit, len, 0);
+        end_tcp(&players[i]);
+        close(players[i].udp_fd);
+    }
+
+    print_report(elapsed);
+    free(players);
+    free(ready);
+    close(epoll_fd);
+    return 0;
+}
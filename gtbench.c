@@ -0,0 +1,138 @@
+/*
+ * gtbench.c
+ *
+ * Memory and throughput benchmark of the game table (game_table.c), the in-memory state of
+ * a worker shard. It fills one table with N concurrent games, as SNG would, then runs rounds
+ * of guesses over all of them in random order, as TRY would (lookup, duplicate check against
+ * the history, scoring, append), and finally removes every game.
+ *
+ * It prints the bytes taken per game and the rate of each phase. -s picks the shape of the
+ * games (0: 4x6, scored from the table, 1: 5x8, 2: 6x10, scored by their kernels).
+ *
+ * Usage: gtbench [-n games] [-r rounds] [-s shape]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "feedback.h"
+#include "game_table.h"
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *phase, long ops, double seconds) {
+    printf("%-8s %10ld ops %8.1f ms %10.2f Mops/s %8.1f ns/op\n",
+           phase, ops, seconds * 1e3, ops / seconds / 1e6, seconds * 1e9 / ops);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-n games (1-1000000)] [-r rounds] [-s shape (0-%d)]\n", name, N_SHAPES - 1);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    int n_games = 1000000, rounds = 8, shape = SHAPE_4X6, opt;
+    unsigned int seed = 1;
+
+    while ((opt = getopt(argc, argv, "n:r:s:")) != -1) {
+        switch (opt) {
+            case 'n': n_games = atoi(optarg); break;
+            case 'r': rounds = atoi(optarg); break;
+            case 's': shape = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (n_games < 1 || n_games > 1000000 || rounds < 1 || shape < 0 || shape >= N_SHAPES) usage(argv[0]);
+    uint32_t n_codes = game_shapes[shape].codes;
+
+    feedback_init();
+
+    // Random distinct PLIDs, visited in a different random order by the guess rounds
+    uint32_t *plids = malloc(1000000 * sizeof(uint32_t));
+    uint32_t *order = malloc((size_t)n_games * sizeof(uint32_t));
+    if (!plids || !order) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < 1000000; i++) plids[i] = i;
+    for (uint32_t i = 999999; i > 0; i--) {
+        uint32_t j = rand_r(&seed) % (i + 1), tmp = plids[i];
+        plids[i] = plids[j];
+        plids[j] = tmp;
+    }
+    memcpy(order, plids, (size_t)n_games * sizeof(uint32_t));
+    for (uint32_t i = n_games - 1; i > 0; i--) {
+        uint32_t j = rand_r(&seed) % (i + 1), tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    GameTable table;
+    if (game_table_init(&table, GAME_TABLE_INITIAL) < 0) {
+        perror("game_table_init");
+        exit(EXIT_FAILURE);
+    }
+
+    // SNG: one game per player
+    uint32_t start = game_time(time(NULL));
+    double t0 = now_s();
+    for (int i = 0; i < n_games; i++) {
+        Game *game = game_table_insert(&table, plids[i]);
+        if (!game) {
+            perror("game_table_insert");
+            exit(EXIT_FAILURE);
+        }
+        game->shape = shape;
+        game->secret = rand_r(&seed) % n_codes;
+        game->start = start;
+        game->deadline = start + 600;
+        game->active = 1;
+    }
+    report("insert", n_games, now_s() - t0);
+
+    size_t bytes = game_table_bytes(&table);
+    printf("memory   %10d games %8.1f MB %10.1f bytes/game (record %zu + history %zu)\n",
+           n_games, bytes / 1048576.0, (double)bytes / n_games, sizeof(Game), sizeof(GameHistory));
+
+    // TRY: every game gets `rounds` guesses; a game that used all its trials starts over
+    long scored = 0, duplicates = 0;
+    uint32_t checksum = 0;
+    t0 = now_s();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < n_games; i++) {
+            Game *game = game_table_find(&table, order[i]);
+            GameHistory *history = game_history(&table, game);
+            uint32_t guess = (order[i] * 7 + r * 331) % n_codes;
+            int dup = 0;
+
+            if (game->trials == GAME_MAX_TRIALS) game->trials = 0;
+            for (int j = 0; j < game->trials; j++) dup |= history->guesses[j] == guess;
+            if (dup) {
+                duplicates++;
+                continue;
+            }
+            checksum += shape_feedback(game->shape, game->secret, guess);
+            history->guesses[game->trials++] = guess;
+            scored++;
+        }
+    }
+    report("try", (long)n_games * rounds, now_s() - t0);
+
+    // QUT: release every game
+    t0 = now_s();
+    for (int i = 0; i < n_games; i++) game_table_remove(&table, order[i]);
+    report("remove", n_games, now_s() - t0);
+
+    printf("(%ld guesses scored, %ld duplicates, checksum %u)\n", scored, duplicates, checksum);
+    game_table_free(&table);
+    free(plids);
+    free(order);
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * histogram.c
+ *
+ * Log-linear latency histogram, see histogram.h.
+ */
+
+#include "histogram.h"
+
+// Bucket of a value
+static int bucket_of(uint64_t value) {
+    if (value < HIST_LINEAR) return (int)value;
+    int exp = 63 - __builtin_clzll(value);                      // >= 5
+    int sub = (int)(value >> (exp - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1);
+    return HIST_LINEAR + (exp - 5) * (1 << HIST_SUB_BITS) + sub;
+}
+
+// Midpoint of the values of a bucket
+static uint64_t bucket_value(int bucket) {
+    if (bucket < HIST_LINEAR) return (uint64_t)bucket;
+    int exp = (bucket - HIST_LINEAR) / (1 << HIST_SUB_BITS) + 5;
+    uint64_t sub = (uint64_t)((bucket - HIST_LINEAR) % (1 << HIST_SUB_BITS));
+    uint64_t width = 1ull << (exp - HIST_SUB_BITS);
+    return ((1ull << HIST_SUB_BITS) + sub) * width + width / 2;
+}
+
+// Histograms have a single writer but may be merged by another thread while being recorded,
+// so fields are accessed with relaxed atomics (plain loads and stores on x86)
+#define LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+
+void hist_record(Histogram *hist, uint64_t value) {
+    int bucket = bucket_of(value);
+    STORE(hist->counts[bucket], LOAD(hist->counts[bucket]) + 1);
+    STORE(hist->sum, LOAD(hist->sum) + value);
+    if (value > LOAD(hist->max)) STORE(hist->max, value);
+    STORE(hist->total, LOAD(hist->total) + 1);
+}
+
+void hist_merge(Histogram *dst, const Histogram *src) {
+    uint64_t total = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        uint64_t count = LOAD(src->counts[i]);
+        dst->counts[i] += count;
+        total += count;
+    }
+    dst->total += total;    // Consistent with the buckets even if src is being recorded
+    dst->sum += LOAD(src->sum);
+    uint64_t max = LOAD(src->max);
+    if (max > dst->max) dst->max = max;
+}
+
+uint64_t hist_percentile(const Histogram *hist, double percentile) {
+    if (hist->total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * hist->total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > hist->total) rank = hist->total;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            uint64_t value = bucket_value(i);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+    return hist->max;
+}
@@ -0,0 +1,34 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * Log-linear latency histogram (HDR style): values below 32 have their own bucket, larger
+ * values are grouped by power of two, each split into 16 sub-buckets, so any recorded value is
+ * reported within ~6% whatever its magnitude. Recording is a few instructions and no allocation.
+ */
+#define HIST_SUB_BITS 4
+#define HIST_LINEAR 32                                  // Values recorded exactly
+#define HIST_BUCKETS (HIST_LINEAR + (64 - 5) * (1 << HIST_SUB_BITS))
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;         // Number of values
+    uint64_t sum;           // Sum of the values
+    uint64_t max;           // Largest value
+} Histogram;
+
+void hist_record(Histogram *hist, uint64_t value);
+
+// Add the counts of `src` to `dst`
+void hist_merge(Histogram *dst, const Histogram *src);
+
+/**
+ * Value at a percentile (0 to 100), as the midpoint of its bucket.
+ *
+ * @return the value, or 0 if the histogram is empty
+ */
+uint64_t hist_percentile(const Histogram *hist, double percentile);
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * log_ring.c
+ *
+ * Single-producer/single-consumer ring that moves log records from a UDP worker to the log
+ * writer thread without locks or system calls, so a slow disk never blocks a request.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log_ring.h"
+
+int log_ring_init(LogRing *ring, uint32_t capacity) {
+    memset(ring, 0, sizeof(*ring));
+    ring->slots = malloc((size_t)capacity * sizeof(WalRecord));
+    if (!ring->slots) return -1;
+    ring->mask = capacity - 1;
+    return 0;
+}
+
+void log_ring_free(LogRing *ring) {
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+int log_ring_push(LogRing *ring, const WalRecord *record) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (head - ring->tail_cache > ring->mask) {
+        ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->tail_cache > ring->mask) return -1;
+    }
+    ring->slots[head & ring->mask] = *record;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 0;
+}
+
+int log_ring_pop(LogRing *ring, WalRecord *record) {
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if (tail == ring->head_cache) {
+        ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail == ring->head_cache) return 0;
+    }
+    *record = ring->slots[tail & ring->mask];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+int log_ring_empty(LogRing *ring) {
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return tail == ring->head_cache;
+}
@@ -0,0 +1,51 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "wal.h"
+
+#define LOG_RING_SIZE 8192      // Records buffered per worker before it has to wait (power of two)
+#define CACHE_LINE 64
+
+/*
+ * Bounded lock-free single-producer/single-consumer queue of log records, from one UDP worker
+ * to the log writer thread. Each side owns one index and only reads the other's, with
+ * acquire/release ordering; each also keeps a stale copy of the other's index so it only
+ * touches the shared cache line when the ring looks full (producer) or empty (consumer).
+ */
+typedef struct {
+    _Atomic uint64_t head;          // Next slot to fill (written by the producer)
+    uint64_t tail_cache;            // Producer's last view of `tail`
+    char pad0[CACHE_LINE - 2 * sizeof(uint64_t)];
+    _Atomic uint64_t tail;          // Next slot to drain (written by the consumer)
+    uint64_t head_cache;            // Consumer's last view of `head`
+    char pad1[CACHE_LINE - 2 * sizeof(uint64_t)];
+    WalRecord *slots;
+    uint32_t mask;
+} LogRing;
+
+int log_ring_init(LogRing *ring, uint32_t capacity);
+void log_ring_free(LogRing *ring);
+
+/**
+ * Queue a record (producer side).
+ *
+ * @return 0 on success, -1 if the ring is full
+ */
+int log_ring_push(LogRing *ring, const WalRecord *record);
+
+/**
+ * Take the oldest record (consumer side).
+ *
+ * @return 1 if a record was taken, 0 if the ring is empty
+ */
+int log_ring_pop(LogRing *ring, WalRecord *record);
+
+/**
+ * Whether the ring is empty, as seen by the consumer.
+ */
+int log_ring_empty(LogRing *ring);
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * metrics.c
+ *
+ * Request counters and latency histograms. Every thread that answers requests owns one
+ * Metrics block; the blocks are summed only when the metrics document is requested.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "protocol.h"
+
+static const char *command_names[N_COMMANDS] = {"SNG", "TRY", "QUT", "DBG", "STR", "SSB"};
+static const char *outcome_names[N_OUTCOMES] = {"OK", "NOK", "DUP", "INV", "ENT", "ETM", "ERR"};
+
+// Outcomes each command can reply with (only those are exported)
+static const unsigned outcome_mask[N_COMMANDS] = {
+    [CMD_SNG] = 1 << OUTCOME_OK | 1 << OUTCOME_NOK | 1 << OUTCOME_ERR,
+    [CMD_TRY] = 1 << OUTCOME_OK | 1 << OUTCOME_NOK | 1 << OUTCOME_DUP | 1 << OUTCOME_INV |
+                1 << OUTCOME_ENT | 1 << OUTCOME_ETM | 1 << OUTCOME_ERR,
+    [CMD_QUT] = 1 << OUTCOME_OK | 1 << OUTCOME_NOK | 1 << OUTCOME_ERR,
+    [CMD_DBG] = 1 << OUTCOME_OK | 1 << OUTCOME_NOK | 1 << OUTCOME_ERR,
+    [CMD_STR] = 1 << OUTCOME_OK | 1 << OUTCOME_NOK | 1 << OUTCOME_ERR,
+    [CMD_SSB] = 1 << OUTCOME_OK | 1 << OUTCOME_NOK | 1 << OUTCOME_ERR,
+};
+
+static int command_of(const char *request) {
+    if (request[0] == '\0' || request[1] == '\0' || request[2] == '\0') return -1;
+    switch (OPCODE(request[0], request[1], request[2])) {
+        case OPCODE('S', 'N', 'G'): return CMD_SNG;
+        case OPCODE('T', 'R', 'Y'): return CMD_TRY;
+        case OPCODE('Q', 'U', 'T'): return CMD_QUT;
+        case OPCODE('D', 'B', 'G'): return CMD_DBG;
+        case OPCODE('S', 'T', 'R'): return CMD_STR;
+        case OPCODE('S', 'S', 'B'): return CMD_SSB;
+        default: return -1;
+    }
+}
+
+// Replies are "<code> <status>..."
+static Outcome outcome_of(const char *reply) {
+    if (strlen(reply) < 6) return OUTCOME_ERR;
+    switch (OPCODE(reply[4], reply[5], reply[6])) {
+        case OPCODE('O', 'K', ' '):
+        case OPCODE('O', 'K', '\n'):
+        case OPCODE('A', 'C', 'T'):
+        case OPCODE('F', 'I', 'N'): return OUTCOME_OK;
+        case OPCODE('N', 'O', 'K'):
+        case OPCODE('E', 'M', 'P'): return OUTCOME_NOK;
+        case OPCODE('D', 'U', 'P'): return OUTCOME_DUP;
+        case OPCODE('I', 'N', 'V'): return OUTCOME_INV;
+        case OPCODE('E', 'N', 'T'): return OUTCOME_ENT;
+        case OPCODE('E', 'T', 'M'): return OUTCOME_ETM;
+        default: return OUTCOME_ERR;
+    }
+}
+
+void metrics_record(Metrics *metrics, const char *request, const char *reply, uint64_t latency_ns) {
+    int command = command_of(request);
+    if (command < 0) {
+        counter_add(&metrics->unknown, 1);
+        return;
+    }
+    counter_add(&metrics->requests[command][outcome_of(reply)], 1);
+    hist_record(&metrics->latency[command], latency_ns);
+}
+
+static uint64_t sum(Metrics *const *blocks, int n_blocks, size_t offset) {
+    uint64_t total = 0;
+    for (int i = 0; i < n_blocks; i++)
+        total += __atomic_load_n((const uint64_t *)((const char *)blocks[i] + offset), __ATOMIC_RELAXED);
+    return total;
+}
+
+int metrics_format(Metrics *const *blocks, int n_blocks, char *buffer, int size) {
+    static const double quantiles[] = {50, 90, 99, 99.9};
+    int len = 0;
+
+#define APPEND(...) do { if (len < size) len += snprintf(buffer + len, size - len, __VA_ARGS__); } while (0)
+
+    APPEND("# TYPE gs_requests_total counter\n");
+    for (int c = 0; c < N_COMMANDS; c++) {
+        for (int o = 0; o < N_OUTCOMES; o++) {
+            if (!(outcome_mask[c] >> o & 1)) continue;
+            APPEND("gs_requests_total{cmd=\"%s\",outcome=\"%s\"} %lu\n", command_names[c], outcome_names[o],
+                   sum(blocks, n_blocks, offsetof(Metrics, requests[c][o])));
+        }
+    }
+
+    APPEND("# TYPE gs_request_latency_ns summary\n");
+    for (int c = 0; c < N_COMMANDS; c++) {
+        Histogram latency;
+        memset(&latency, 0, sizeof(latency));
+        for (int i = 0; i < n_blocks; i++) hist_merge(&latency, &blocks[i]->latency[c]);
+        for (unsigned q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+            APPEND("gs_request_latency_ns{cmd=\"%s\",quantile=\"%g\"} %lu\n", command_names[c],
+                   quantiles[q] / 100, hist_percentile(&latency, quantiles[q]));
+        APPEND("gs_request_latency_ns_sum{cmd=\"%s\"} %lu\n", command_names[c], latency.sum);
+        APPEND("gs_request_latency_ns_count{cmd=\"%s\"} %lu\n", command_names[c], latency.total);
+        APPEND("gs_request_latency_ns_max{cmd=\"%s\"} %lu\n", command_names[c], latency.max);
+    }
+
+    APPEND("# TYPE gs_unknown_requests_total counter\ngs_unknown_requests_total %lu\n",
+           sum(blocks, n_blocks, offsetof(Metrics, unknown)));
+    APPEND("# TYPE gs_udp_datagrams_received_total counter\ngs_udp_datagrams_received_total %lu\n",
+           sum(blocks, n_blocks, offsetof(Metrics, received)));
+    APPEND("# TYPE gs_udp_datagrams_dropped_total counter\ngs_udp_datagrams_dropped_total %lu\n",
+           sum(blocks, n_blocks, offsetof(Metrics, dropped)));
+    APPEND("# TYPE gs_udp_reply_failures_total counter\ngs_udp_reply_failures_total %lu\n",
+           sum(blocks, n_blocks, offsetof(Metrics, reply_failures)));
+    APPEND("# TYPE gs_udp_replayed_total counter\ngs_udp_replayed_total %lu\n",
+           sum(blocks, n_blocks, offsetof(Metrics, replayed)));
+    APPEND("# TYPE gs_log_ring_full_total counter\ngs_log_ring_full_total %lu\n",
+           sum(blocks, n_blocks, offsetof(Metrics, log_stalls)));
+    APPEND("# TYPE gs_log_ring_wait_seconds_total counter\ngs_log_ring_wait_seconds_total %.6f\n",
+           sum(blocks, n_blocks, offsetof(Metrics, log_stall_ns)) / 1e9);
+
+#undef APPEND
+    return len < size ? len : size - 1;
+}
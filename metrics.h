@@ -0,0 +1,58 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#include "histogram.h"
+
+// Commands with their own counters and latency histogram
+typedef enum {
+    CMD_SNG, CMD_TRY, CMD_QUT, CMD_DBG, CMD_STR, CMD_SSB, N_COMMANDS
+} Command;
+
+// Status word of the reply (ACT/FIN count as OK, EMPTY as NOK)
+typedef enum {
+    OUTCOME_OK, OUTCOME_NOK, OUTCOME_DUP, OUTCOME_INV, OUTCOME_ENT, OUTCOME_ETM, OUTCOME_ERR, N_OUTCOMES
+} Outcome;
+
+/*
+ * Counters of one thread (a UDP worker or the TCP loop). Each block has a single writer, which
+ * updates it with relaxed atomic stores; the metrics request reads all blocks concurrently,
+ * so no locks are taken on the request path.
+ */
+typedef struct {
+    uint64_t requests[N_COMMANDS][N_OUTCOMES];
+    Histogram latency[N_COMMANDS];  // Nanoseconds from receiving a request to its reply
+    uint64_t unknown;               // Requests that are not a command
+    uint64_t received;              // UDP datagrams received
+    uint64_t dropped;               // UDP datagrams dropped by the kernel (socket buffer full)
+    uint64_t reply_failures;        // UDP replies that could not be sent
+    uint64_t replayed;              // Retransmitted UDP requests answered from the reply cache
+    uint64_t log_stalls;            // Log records that found the worker's ring full
+    uint64_t log_stall_ns;          // Time spent waiting for room in the ring
+} Metrics;
+
+// Single-writer increment, safe against concurrent readers
+static inline void counter_add(uint64_t *counter, uint64_t n) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+// Single-writer update of a counter maintained elsewhere (e.g. by the kernel)
+static inline void counter_set(uint64_t *counter, uint64_t value) {
+    __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Count a request and its latency, classified by the opcode of the request and the status
+ * word of the reply.
+ */
+void metrics_record(Metrics *metrics, const char *request, const char *reply, uint64_t latency_ns);
+
+/**
+ * Format the sum of several blocks as a text metrics document (Prometheus exposition format).
+ *
+ * @return length of the document
+ */
+int metrics_format(Metrics *const *blocks, int n_blocks, char *buffer, int size);
+
+#endif
@@ -4,11 +4,13 @@
  * interacts with the server to manage game sessions. 
  *
  * Main Features:
- * - Processes command-line arguments to configure the server's IP and port.
+ * - Processes command-line arguments to configure the server's IP and port, and the
+ *   number of times a UDP request is sent before giving up; -k keeps one TCP connection open
+ *   for all the show_trials/scoreboard requests.
  * - Initializes TCP and UDP sockets for communication with the server.
  * - Implements a command-line interface to handle the following user commands:
- *   - start: Starts a new game session with the server.
- *   - try: Submits a guess for the game.
+ *   - start: Starts a new game session with the server (4 pegs and 6 colours unless given).
+ *   - try: Submits a guess for the game (one colour per peg).
  *   - show_trials (or st): Retrieves and displays trial information via TCP.
  *   - scoreboard (or sb): Retrieves the scoreboard via TCP.
  *   - quit: Ends the current game session.
@@ -20,18 +22,36 @@
 #include "command_handlers.h"
 #include "player.h"
 
+// Read space-separated one-letter colours ("R G B Y") into `code`, normalized to single
+// spaces; returns the number of colours, or -1 if the layout is wrong or there are too many
+static int parse_colors(const char *text, char *code) {
+    int n = 0, len = 0;
+
+    while (*text == ' ') text++;
+    while (*text && *text != '\n') {
+        if (n == MAX_PEGS || (text[1] != ' ' && text[1] != '\n' && text[1] != '\0')) return -1;
+        if (n > 0) code[len++] = ' ';
+        code[len++] = *text++;
+        n++;
+        while (*text == ' ') text++;
+    }
+    code[len] = '\0';
+    return n;
+}
+
 int main (int argc, char** argv){
     char *gs_ip = NULL;
     char *gs_port = PORT;
     bool in_game = false;
     char plid[7] = {0};
     int fdudp, fdtcp, nT = 0;
+    int pegs = DEFAULT_PEGS;    // Pegs of the current game
     struct addrinfo *resudp, *restcp;
     char command[256];
 
     // Process command-line arguments
     int opt;
-    while ((opt = getopt(argc, argv, "n:p:")) != -1) {
+    while ((opt = getopt(argc, argv, "n:p:a:k")) != -1) {
         switch (opt) {
             case 'n':
                 gs_ip = optarg;
@@ -40,9 +60,17 @@ int main (int argc, char** argv){
             case 'p':
                 gs_port = optarg;
                 break;
+
+            case 'a':
+                udp_set_max_attempts(atoi(optarg));
+                break;
+
+            case 'k':
+                tcp_set_keep_alive(1);
+                break;
             
             default:
-                fprintf(stderr, "Usage: %s [-n GSIP] [-n GSport]\n", argv[0]);
+                fprintf(stderr, "Usage: %s [-n GSIP] [-p GSport] [-a attempts] [-k]\n", argv[0]);
                 exit(1);
         }
     }
@@ -64,37 +92,40 @@ int main (int argc, char** argv){
         //----------- Parse commands -----------//
         /* start command */
         if (strncmp(command, "start", 5) == 0) {
-            int max_playtime;
-            if (sscanf(command, "start %6s %d", plid, &max_playtime) == 2){
+            int max_playtime, game_pegs = 0, game_colors = 0;
+            int fields = sscanf(command, "start %6s %d %d %d", plid, &max_playtime, &game_pegs, &game_colors);
+            if (fields == 2 || fields == 4){
                 if (strlen(plid) != 6) {
                     printf("Error: Invalid PLID\n");
                     continue;
                 }
-                int ret = handle_start(fdudp, resudp, plid, max_playtime);
-                if (ret == 0) in_game = true;
+                int ret = handle_start(fdudp, resudp, plid, max_playtime, game_pegs, game_colors);
+                if (ret == 0) {
+                    in_game = true;
+                    nT = 0;
+                    pegs = game_pegs > 0 ? game_pegs : DEFAULT_PEGS;
+                }
                     
             }
             else{
-                printf("Usage: start PLID max_playtime\n");
+                printf("Usage: start PLID max_playtime [pegs colours]\n");
                 continue;
             }
 
 
         /* try command */
         } else if (strncmp(command, "try", 3) == 0) {
-            char guess[10];
+            char guess[2 * MAX_PEGS];
 
-            if (sscanf(command, "try %[^\n]s", guess) == 1) {
-                char colors[4];
-
-                // Parse the 4 colors from the user's guess
-                if (sscanf(guess, "%c %c %c %c", &colors[0], &colors[1], &colors[2], &colors[3]) != 4){
-                    printf("Usage: try C1 C2 C3 C4\n");
+            if (strncmp(command, "try ", 4) == 0) {
+                // Parse one colour per peg from the user's guess
+                if (parse_colors(command + 4, guess) != pegs){
+                    printf("Usage: try C1 ... C%d\n", pegs);
                     continue;
                     }
                 // Continue only if all the colors are valid
                 
-                    int ret = handle_try(fdudp, resudp, guess, ++nT, plid); 
+                    int ret = handle_try(fdudp, resudp, guess, ++nT, plid, pegs); 
 
                 if (ret == 1) { // End game
                     in_game = false;
@@ -105,7 +136,7 @@ int main (int argc, char** argv){
                 }
                 
             }
-            else printf("Usage: try C1 C2 C3 C4\n");
+            else printf("Usage: try C1 ... C%d\n", pegs);
                 
         /* show_trials command */
         } else if (strncmp(command, "show_trials", 11) == 0 || strncmp(command, "st", 2) == 0) { 
@@ -128,20 +159,25 @@ int main (int argc, char** argv){
             break;
         /* debug command */
         } else if (strncmp(command, "debug", 5) == 0) { // TODO what is this
-            char key[10];
-            int max_playtime, ret;
-            char colors[4];
-            if (sscanf(command, "debug %6s %d %c %c %c %c", plid, &max_playtime, &colors[0], &colors[1], &colors[2], &colors[3]) == 6) {
-                snprintf(key, sizeof(key), "%c %c %c %c", colors[0], colors[1], colors[2], colors[3]);
+            char key[2 * MAX_PEGS];
+            int max_playtime, ret, offset = 0, key_pegs = -1;
+            if (sscanf(command, "debug %6s %d %n", plid, &max_playtime, &offset) == 2 && offset > 0 &&
+                (key_pegs = parse_colors(command + offset, key)) >= DEFAULT_PEGS) {
+                // The number of colours of the key selects the game shape
                 ret = handle_debug(fdudp, resudp, plid, max_playtime, key);
-                if (ret == 0) in_game = true;
+                if (ret == 0) {
+                    in_game = true;
+                    nT = 0;
+                    pegs = key_pegs;
+                }
             } else 
-                printf("Usage: debug PLID max_playtime C1 C2 C3 C4\n");
+                printf("Usage: debug PLID max_playtime C1 ... Cn (4 to %d colours)\n", MAX_PEGS);
         } else {
             printf("Unknown command\n");
         }
     }
 
+    udp_print_stats();
     close_connection(fdudp, fdtcp, restcp, resudp);
 
     return 0;
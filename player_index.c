@@ -0,0 +1,220 @@
+/*
+ * player_index.c
+ *
+ * Persistent index of finished games, keyed by PLID. The index is a memory-mapped file
+ * (PLAYER_INDEX_FILE) holding an open-addressing table with linear probing: for each player,
+ * the name and size of the last finished game and the number of finished games. STR of a
+ * finished game is then a single lookup instead of a scandir of the player's directory.
+ *
+ * The materializer records each game as it is archived; the TCP thread reads the index, so
+ * access is protected by a mutex. When the table gets 70% full it is rehashed into a new
+ * file of twice the size, which replaces the old one with rename(). If the file is missing
+ * or invalid at startup, it is rebuilt by scanning GAMES/.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "game_table.h"
+#include "player_index.h"
+
+static PlayerIndexHeader *header = NULL;
+static PlayerEntry *entries = NULL;
+static size_t map_size = 0;
+static uint32_t shift = 0;
+
+static pthread_mutex_t index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Home bucket of a key
+static uint32_t bucket_of(uint32_t key) {
+    return (uint32_t)(key * 2654435761u) >> shift;
+}
+
+// Map a file of `capacity` buckets; a new file is created empty
+static int map_file(const char *path, uint32_t capacity, int create) {
+    size_t size = sizeof(PlayerIndexHeader) + (size_t)capacity * sizeof(PlayerEntry);
+    int fd = open(path, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+    if (fd < 0) return -1;
+
+    if (create && ftruncate(fd, size) < 0) {
+        perror("Failed to size player index");
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Failed to map player index");
+        return -1;
+    }
+
+    header = map;
+    entries = (PlayerEntry *)(header + 1);
+    map_size = size;
+    if (create) {
+        header->magic = PLAYER_INDEX_MAGIC;
+        header->entry_size = sizeof(PlayerEntry);
+        header->capacity = capacity;
+        header->count = 0;
+        for (uint32_t b = 0; b < capacity; b++) entries[b].key = EMPTY_KEY;
+    }
+    uint32_t bits = 0;
+    while ((1u << bits) < capacity) bits++;
+    shift = 32 - bits;
+    return 0;
+}
+
+static void unmap(void) {
+    if (header) munmap(header, map_size);
+    header = NULL;
+    entries = NULL;
+    map_size = 0;
+}
+
+// Bucket of a key, or the free bucket where it would go
+static PlayerEntry *probe(uint32_t key) {
+    uint32_t mask = header->capacity - 1;
+    uint32_t b = bucket_of(key);
+    while (entries[b].key != key && entries[b].key != EMPTY_KEY) b = (b + 1) & mask;
+    return &entries[b];
+}
+
+// Rehash into a file with twice the buckets
+static int grow(void) {
+    char tmp[64];
+    PlayerIndexHeader *old_header = header;
+    PlayerEntry *old_entries = entries;
+    size_t old_size = map_size;
+    uint32_t old_shift = shift;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", PLAYER_INDEX_FILE);
+    if (map_file(tmp, old_header->capacity * 2, 1) < 0) {
+        header = old_header;
+        entries = old_entries;
+        map_size = old_size;
+        shift = old_shift;
+        return -1;
+    }
+    for (uint32_t b = 0; b < old_header->capacity; b++) {
+        if (old_entries[b].key == EMPTY_KEY) continue;
+        *probe(old_entries[b].key) = old_entries[b];
+        header->count++;
+    }
+    munmap(old_header, old_size);
+    if (rename(tmp, PLAYER_INDEX_FILE) < 0) perror("Failed to replace player index");
+    return 0;
+}
+
+// Must be called with the mutex held
+static void record(uint32_t key, const char *name, uint32_t size) {
+    if ((header->count + 1) * 10 > header->capacity * 7 && grow() < 0) return;
+
+    PlayerEntry *entry = probe(key);
+    if (entry->key == EMPTY_KEY) {
+        memset(entry, 0, sizeof(*entry));
+        entry->key = key;
+        header->count++;
+    }
+
+    int cmp = entry->games ? strcmp(name, entry->last) : 1;
+    if (cmp < 0) return;        // An older game: already counted
+    if (cmp > 0) entry->games++;
+    snprintf(entry->last, sizeof(entry->last), "%s", name);
+    entry->last_size = size;
+}
+
+// Rebuild the index from the archived game files; returns 1, or -1 on error
+static int rebuild(void) {
+    DIR *games = opendir("GAMES");
+    struct dirent *player;
+
+    if (map_file(PLAYER_INDEX_FILE, PLAYER_INDEX_INITIAL, 1) < 0) {
+        if (games) closedir(games);
+        return -1;
+    }
+    if (!games) return 1;
+
+    while ((player = readdir(games)) != NULL) {
+        char dirname[300], last[28] = "";
+        uint32_t count = 0;
+        int key = plid_key(player->d_name);
+        if (key < 0) continue;
+
+        snprintf(dirname, sizeof(dirname), "GAMES/%s", player->d_name);
+        DIR *dir = opendir(dirname);
+        if (!dir) continue;
+
+        struct dirent *game;
+        while ((game = readdir(dir)) != NULL) {
+            // Archived games only (the active one is GAME_<PLID>.txt)
+            if (game->d_name[0] < '0' || game->d_name[0] > '9') continue;
+            if (strlen(game->d_name) >= sizeof(last)) continue;
+            count++;
+            if (strcmp(game->d_name, last) > 0) strcpy(last, game->d_name);
+        }
+        closedir(dir);
+        if (count == 0) continue;
+
+        char path[400];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dirname, last);
+        record(key, last, stat(path, &st) == 0 ? (uint32_t)st.st_size : 0);
+        probe(key)->games = count;
+    }
+    closedir(games);
+    return 1;
+}
+
+int player_index_open(void) {
+    struct stat st;
+    int ret;
+
+    pthread_mutex_lock(&index_mutex);
+    if (stat(PLAYER_INDEX_FILE, &st) == 0 && (size_t)st.st_size >= sizeof(PlayerIndexHeader)) {
+        uint32_t capacity = (st.st_size - sizeof(PlayerIndexHeader)) / sizeof(PlayerEntry);
+        if (map_file(PLAYER_INDEX_FILE, capacity, 0) == 0) {
+            if (header->magic == PLAYER_INDEX_MAGIC && header->entry_size == sizeof(PlayerEntry) &&
+                header->capacity == capacity && capacity && (capacity & (capacity - 1)) == 0) {
+                pthread_mutex_unlock(&index_mutex);
+                return 0;
+            }
+            unmap();
+        }
+    }
+    ret = rebuild();
+    pthread_mutex_unlock(&index_mutex);
+    return ret;
+}
+
+void player_index_record(const char *plid, const char *name, uint32_t size) {
+    int key = plid_key(plid);
+    if (key < 0) return;
+
+    pthread_mutex_lock(&index_mutex);
+    if (header) record(key, name, size);
+    pthread_mutex_unlock(&index_mutex);
+}
+
+uint32_t player_index_lookup(const char *plid, char *name, uint32_t *size) {
+    uint32_t games = 0;
+    int key = plid_key(plid);
+    if (key < 0) return 0;
+
+    pthread_mutex_lock(&index_mutex);
+    if (header) {
+        PlayerEntry *entry = probe(key);
+        if (entry->key == (uint32_t)key && entry->games) {
+            strcpy(name, entry->last);
+            if (size) *size = entry->last_size;
+            games = entry->games;
+        }
+    }
+    pthread_mutex_unlock(&index_mutex);
+    return games;
+}
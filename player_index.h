@@ -0,0 +1,47 @@
+#ifndef PLAYER_INDEX_H
+#define PLAYER_INDEX_H
+
+#include <stdint.h>
+
+#define PLAYER_INDEX_FILE "GAMES/players.idx"
+#define PLAYER_INDEX_MAGIC 0x58444950u      // "PIDX"
+#define PLAYER_INDEX_INITIAL 1024           // Initial bucket count
+
+// File header, followed by `capacity` entries
+typedef struct {
+    uint32_t magic;
+    uint32_t entry_size;    // sizeof(PlayerEntry), rejects files of another layout
+    uint32_t capacity;      // Number of buckets (power of two)
+    uint32_t count;         // Players in the index
+} PlayerIndexHeader;
+
+// One player's finished games
+typedef struct {
+    uint32_t key;           // Packed PLID (EMPTY_KEY if free)
+    uint32_t games;         // Number of finished games
+    uint32_t last_size;     // Size of the last game file (bytes)
+    char last[28];          // File name of the last game (YYYYMMDD_HHMMSS_C.txt)
+} PlayerEntry;
+
+/**
+ * Map the index, rebuilding it from the GAMES directory if it is missing or invalid.
+ *
+ * @return 0 if the existing index was mapped, 1 if it was rebuilt, -1 on error
+ */
+int player_index_open(void);
+
+/**
+ * Record a finished game (called after its file got its final name). Older or already
+ * recorded games do not change the last game, so WAL replay is idempotent.
+ */
+void player_index_record(const char *plid, const char *name, uint32_t size);
+
+/**
+ * Find the last finished game of a player.
+ *
+ * @param name receives the file name (inside GAMES/<PLID>/), at least 28 bytes
+ * @return number of finished games (0 if none)
+ */
+uint32_t player_index_lookup(const char *plid, char *name, uint32_t *size);
+
+#endif
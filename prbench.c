@@ -0,0 +1,334 @@
+/*
+ * prbench.c
+ *
+ * Check and benchmark of the UDP request parser (protocol.c) against a corpus of datagrams
+ * (udp_corpus.txt): well-formed requests of every command and shape, and mutations of them
+ * (bytes replaced, dropped or inserted). Each corpus line holds a datagram, escaped, and the
+ * outcome parse_udp_request is expected to give it.
+ *
+ * Every datagram is also parsed the way the server did before parse_udp_request, with sscanf
+ * and fixed offsets. Where the two disagree, the change must be one of the rule changes of
+ * the single-pass parser (listed in `changes`); any other difference is reported as unexpected.
+ * Finally the corpus is parsed -r times by each parser and the rate of each one is printed.
+ *
+ * With -g it prints the corpus back with the outcomes of the current parser instead, to
+ * regenerate the expectations after an intended change of the protocol (into another file:
+ * prbench -g -f udp_corpus.txt > new_corpus.txt).
+ *
+ * Usage: prbench [-f corpus] [-r rounds] [-g]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "feedback.h"
+#include "game_table.h"
+#include "protocol.h"
+
+#define CORPUS_FILE "udp_corpus.txt"
+#define DATAGRAM_SIZE 256       // BUFFER_SIZE of the server
+#define OUTCOME_SIZE 64
+#define MAX_TRANSITIONS 64
+
+typedef struct {
+    char datagram[DATAGRAM_SIZE];
+    char expected[OUTCOME_SIZE];
+} CorpusEntry;
+
+// A kind of disagreement between the old and the new parser, by the classes of their outcomes
+typedef struct {
+    char from[16], to[16];
+    long count;
+    char example[DATAGRAM_SIZE];
+} Transition;
+
+// Disagreements explained by the rules of the single-pass parser
+static const struct {
+    const char *from, *to, *rule;
+} changes[] = {
+    {"SNG OK", "SNG ERR", "playtime 1-600, fields end the command"},
+    {"SNG OK", "SNG OK*", "pegs and colours select the shape"},
+    {"TRY OK", "TRY ERR", "fields end the command, trial of 1-3 digits"},
+    {"TRY INV", "TRY ERR", "misplaced spaces are a syntax error"},
+    {"TRY ERR", "TRY OK", "codes of 5 and 6 pegs"},
+    {"TRY ERR", "TRY INV", "codes of 5 and 6 pegs"},
+    {"QUT OK", "QUT ERR", "invalid PLID or trailing fields are a syntax error"},
+    {"DBG OK", "DBG ERR", "fields end the command"},
+    {"DBG OK", "DBG OK*", "codes of 5 and 6 pegs"},
+    {"DBG ERR", "DBG OK", "codes of 5 and 6 pegs"},
+    {"ERR", "DBG ERR", "a malformed DBG is answered RDB ERR"},
+};
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *phase, long ops, double seconds) {
+    printf("%-8s %10ld ops %8.1f ms %10.2f Mops/s %8.1f ns/op\n",
+           phase, ops, seconds * 1e3, ops / seconds / 1e6, seconds * 1e9 / ops);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-f corpus] [-r rounds] [-g]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+// Parsing of the server before parse_udp_request: sscanf, fixed offsets and strchr on the
+// classic colours, with the checks handle_udp_message and process_guess made before touching
+// any game (a QUT took any %6s as its PLID and answered NOK for an invalid one)
+static void parse_udp_request_sscanf(const char *buffer, UdpRequest *req) {
+    char c1, c2, c3, c4;
+
+    memset(req, 0, sizeof(*req));
+    req->type = REQ_UNKNOWN;
+    req->status = PARSE_ERR;
+    req->shape = SHAPE_4X6;
+
+    if (strncmp(buffer, "SNG", 3) == 0) {
+        req->type = REQ_SNG;
+        if (sscanf(buffer, "SNG %6s %3d", req->plid, &req->max_playtime) == 2 && plid_key(req->plid) >= 0 &&
+            req->max_playtime <= MAX_PLAYTIME)
+            req->status = PARSE_OK;
+
+    } else if (strncmp(buffer, "TRY", 3) == 0) {
+        req->type = REQ_TRY;
+        if (sscanf(buffer, "TRY %6s %c %c %c %c %d", req->plid, &c1, &c2, &c3, &c4, &req->trial) != 6) return;
+        if (buffer[10] != ' ' || buffer[12] != ' ' || buffer[14] != ' ' || buffer[16] != ' ' || buffer[18] != ' ' ||
+            !strchr("RGBYOP", c1) || !strchr("RGBYOP", c2) || !strchr("RGBYOP", c3) || !strchr("RGBYOP", c4)) {
+            req->status = PARSE_INV;
+            return;
+        }
+        sprintf(req->colors, "%c%c%c%c", c1, c2, c3, c4);
+        if (plid_key(req->plid) >= 0) req->status = PARSE_OK;
+
+    } else if (strncmp(buffer, "QUT", 3) == 0) {
+        req->type = REQ_QUT;
+        if (sscanf(buffer, "QUT %6s", req->plid) == 1) req->status = PARSE_OK;
+
+    } else if (sscanf(buffer, "DBG %6s %d %c %c %c %c", req->plid, &req->max_playtime, &c1, &c2, &c3, &c4) == 6) {
+        req->type = REQ_DBG;
+        sprintf(req->colors, "%c%c%c%c", c1, c2, c3, c4);
+        if (plid_key(req->plid) >= 0 && req->max_playtime > 0 && req->max_playtime <= MAX_PLAYTIME &&
+            strchr("RGBYOP", c1) && strchr("RGBYOP", c2) && strchr("RGBYOP", c3) && strchr("RGBYOP", c4))
+            req->status = PARSE_OK;
+    }
+}
+
+// Outcome of a parse as text: "ERR" for an unknown command, "<CMD> ERR", "TRY INV", or the
+// command with its fields ("SNG OK 123456 100 4x6", "TRY OK 123456 RGBY 1", ...)
+static void describe(const UdpRequest *req, char *out) {
+    static const char *names[] = {"ERR", "SNG", "TRY", "QUT", "DBG"};
+    const GameShape *shape = &game_shapes[req->shape];
+
+    if (req->type == REQ_UNKNOWN) {
+        strcpy(out, "ERR");
+    } else if (req->status != PARSE_OK) {
+        sprintf(out, "%s %s", names[req->type], req->status == PARSE_INV ? "INV" : "ERR");
+    } else if (req->type == REQ_SNG) {
+        snprintf(out, OUTCOME_SIZE, "SNG OK %s %d %dx%d", req->plid, req->max_playtime, shape->pegs, shape->colors);
+    } else if (req->type == REQ_TRY) {
+        snprintf(out, OUTCOME_SIZE, "TRY OK %s %s %d", req->plid, req->colors, req->trial);
+    } else if (req->type == REQ_QUT) {
+        snprintf(out, OUTCOME_SIZE, "QUT OK %s", req->plid);
+    } else {
+        snprintf(out, OUTCOME_SIZE, "DBG OK %s %d %s", req->plid, req->max_playtime, req->colors);
+    }
+}
+
+// Class of an outcome: its first two words ("SNG OK"), or "ERR"
+static void outcome_class(const char *outcome, char *class) {
+    int words = 0, i = 0;
+    for (; outcome[i] && i < 15; i++) {
+        if (outcome[i] == ' ' && ++words == 2) break;
+        class[i] = outcome[i];
+    }
+    class[i] = '\0';
+}
+
+// Corpus lines escape the bytes of a datagram that are not printable, and '\\'
+static void escape(const char *datagram, char *out) {
+    for (; *datagram; datagram++) {
+        unsigned char c = *datagram;
+        if (c == '\n') out += sprintf(out, "\\n");
+        else if (c == '\t') out += sprintf(out, "\\t");
+        else if (c == '\\') out += sprintf(out, "\\\\");
+        else if (c < 0x20 || c >= 0x7F) out += sprintf(out, "\\x%02X", c);
+        else *out++ = c;
+    }
+    *out = '\0';
+}
+
+static int unescape(const char *text, char *datagram) {
+    int n = 0;
+    while (*text && n < DATAGRAM_SIZE - 1) {
+        unsigned value;
+        if (text[0] != '\\') {
+            datagram[n++] = *text++;
+        } else if (text[1] == 'n' || text[1] == 't' || text[1] == '\\') {
+            datagram[n++] = text[1] == 'n' ? '\n' : text[1] == 't' ? '\t' : '\\';
+            text += 2;
+        } else if (text[1] == 'x' && sscanf(text + 2, "%2x", &value) == 1 && value > 0) {
+            datagram[n++] = (char)value;
+            text += 4;
+        } else {
+            return -1;
+        }
+    }
+    datagram[n] = '\0';
+    return *text ? -1 : 0;
+}
+
+// Lines: escaped datagram, a tab, the expected outcome; '#' starts a comment line
+static CorpusEntry *load_corpus(const char *path, int *count) {
+    char line[4 * DATAGRAM_SIZE + OUTCOME_SIZE];
+    int cap = 0, n = 0, number = 0;
+    CorpusEntry *entries = NULL;
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') continue;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 1024;
+            CorpusEntry *grown = realloc(entries, cap * sizeof(CorpusEntry));
+            if (!grown) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+            entries = grown;
+        }
+        char *tab = strchr(line, '\t');
+        if (!tab || strlen(tab + 1) >= OUTCOME_SIZE) {
+            fprintf(stderr, "%s:%d: expected <datagram> TAB <outcome>\n", path, number);
+            exit(EXIT_FAILURE);
+        }
+        *tab = '\0';
+        if (unescape(line, entries[n].datagram) < 0) {
+            fprintf(stderr, "%s:%d: bad escape\n", path, number);
+            exit(EXIT_FAILURE);
+        }
+        strcpy(entries[n].expected, tab + 1);
+        n++;
+    }
+    fclose(file);
+    *count = n;
+    return entries;
+}
+
+static const char *explain(const char *from, const char *to) {
+    for (size_t i = 0; i < sizeof(changes) / sizeof(changes[0]); i++) {
+        if (strcmp(changes[i].from, from) == 0 && strcmp(changes[i].to, to) == 0) return changes[i].rule;
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = CORPUS_FILE;
+    int rounds = 200, regenerate = 0, opt;
+
+    while ((opt = getopt(argc, argv, "f:r:g")) != -1) {
+        switch (opt) {
+            case 'f': path = optarg; break;
+            case 'r': rounds = atoi(optarg); break;
+            case 'g': regenerate = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (rounds < 1) usage(argv[0]);
+
+    feedback_init();
+    int n_entries;
+    CorpusEntry *corpus = load_corpus(path, &n_entries);
+    char outcome[OUTCOME_SIZE], old_outcome[OUTCOME_SIZE], escaped[4 * DATAGRAM_SIZE];
+    UdpRequest req;
+
+    if (regenerate) {
+        printf("# UDP datagrams (escaped) and the outcome parse_udp_request gives them, see prbench.c\n");
+        for (int i = 0; i < n_entries; i++) {
+            parse_udp_request(corpus[i].datagram, &req);
+            describe(&req, outcome);
+            escape(corpus[i].datagram, escaped);
+            printf("%s\t%s\n", escaped, outcome);
+        }
+        return 0;
+    }
+
+    // The current parser must give the recorded outcomes; the old one may only differ by the rule changes
+    Transition transitions[MAX_TRANSITIONS];
+    int n_transitions = 0;
+    long failures = 0, agreed = 0;
+    for (int i = 0; i < n_entries; i++) {
+        parse_udp_request(corpus[i].datagram, &req);
+        describe(&req, outcome);
+        if (strcmp(outcome, corpus[i].expected) != 0) {
+            escape(corpus[i].datagram, escaped);
+            fprintf(stderr, "\"%s\": expected %s, got %s\n", escaped, corpus[i].expected, outcome);
+            failures++;
+        }
+
+        parse_udp_request_sscanf(corpus[i].datagram, &req);
+        describe(&req, old_outcome);
+        if (strcmp(outcome, old_outcome) == 0) {
+            agreed++;
+            continue;
+        }
+        char from[16], to[16];
+        outcome_class(old_outcome, from);
+        outcome_class(outcome, to);
+        if (strcmp(from, to) == 0) strcat(to, "*");    // Both accepted, with different fields
+
+        int t = 0;
+        while (t < n_transitions && (strcmp(transitions[t].from, from) != 0 || strcmp(transitions[t].to, to) != 0)) t++;
+        if (t == n_transitions) {
+            if (n_transitions == MAX_TRANSITIONS) continue;
+            n_transitions++;
+            strcpy(transitions[t].from, from);
+            strcpy(transitions[t].to, to);
+            transitions[t].count = 0;
+            strcpy(transitions[t].example, corpus[i].datagram);
+        }
+        transitions[t].count++;
+    }
+
+    printf("%d datagrams, %ld parsed alike by the old parser\n", n_entries, agreed);
+    for (int t = 0; t < n_transitions; t++) {
+        const char *rule = explain(transitions[t].from, transitions[t].to);
+        escape(transitions[t].example, escaped);
+        printf("  %-8s -> %-8s %6ld  %s (e.g. \"%s\")\n", transitions[t].from, transitions[t].to, transitions[t].count,
+               rule ? rule : "UNEXPECTED", escaped);
+        if (!rule) failures++;
+    }
+
+    // Parse the whole corpus `rounds` times with each parser
+    long ops = (long)n_entries * rounds, checksum = 0;
+    double t0 = now_s();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < n_entries; i++) {
+            parse_udp_request_sscanf(corpus[i].datagram, &req);
+            checksum += req.status;
+        }
+    }
+    report("sscanf", ops, now_s() - t0);
+    t0 = now_s();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < n_entries; i++) {
+            parse_udp_request(corpus[i].datagram, &req);
+            checksum += req.status;
+        }
+    }
+    report("single", ops, now_s() - t0);
+
+    printf("(%ld failures, checksum %ld)\n", failures, checksum);
+    free(corpus);
+    return failures ? EXIT_FAILURE : 0;
+}
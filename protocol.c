@@ -0,0 +1,129 @@
+/*
+ * protocol.c
+ *
+ * Parser of the UDP text protocol. A datagram is read once from left to right: the opcode is
+ * loaded as a 24-bit integer and dispatched with a switch, digits are accumulated in place
+ * and colours are checked through the feedback module's 256-entry lookup table. No sscanf,
+ * no copies beyond the fields of the typed request.
+ */
+
+#include <stddef.h>
+
+#include "feedback.h"
+#include "protocol.h"
+
+// A field ends at a space, the end of the line or the end of the datagram
+#define END_OF_LINE(c) ((c) == '\0' || (c) == '\n')
+
+// 6-digit PLID; returns the position after it, or NULL
+static const char *parse_plid(const char *p, UdpRequest *req) {
+    int key = 0;
+    for (int i = 0; i < 6; i++) {
+        unsigned digit = (unsigned)(p[i] - '0');
+        if (digit > 9) return NULL;
+        key = key * 10 + (int)digit;
+        req->plid[i] = p[i];
+    }
+    req->plid[6] = '\0';
+    req->key = key;
+    return p + 6;
+}
+
+// Unsigned number of 1 to max_digits digits; returns the position after it, or NULL
+static const char *parse_number(const char *p, int max_digits, int *value) {
+    int n = 0, i = 0;
+    for (; i < max_digits; i++) {
+        unsigned digit = (unsigned)(p[i] - '0');
+        if (digit > 9) break;
+        n = n * 10 + (int)digit;
+    }
+    if (i == 0) return NULL;
+    *value = n;
+    return p + i;
+}
+
+// " C1 ... Cn": one-letter fields up to the next number or the end of the line; the number of
+// letters selects the shape. Returns the position after them, or NULL if the layout is wrong
+// or no shape has that many pegs. *valid is cleared if a letter is not a colour of the shape.
+static const char *parse_code(const char *p, UdpRequest *req, int *valid) {
+    int n = 0, code = 0;
+    for (; p[0] == ' ' && (p[1] < '0' || p[1] > '9'); p += 2) {
+        if (n == MAX_PEGS || p[1] == '\0' || p[1] == ' ' || p[1] == '\n' || (p[2] != ' ' && !END_OF_LINE(p[2]))) return NULL;
+        req->colors[n++] = p[1];
+    }
+    req->colors[n] = '\0';
+    if ((req->shape = shape_of_pegs(n)) < 0) return NULL;
+
+    const GameShape *shape = &game_shapes[req->shape];
+    *valid = 1;
+    for (int i = 0; i < n; i++) {
+        int digit = color_digit(req->colors[i]);
+        *valid &= digit >= 0 && digit < shape->colors;
+        code = code * shape->colors + digit;
+    }
+    req->code = code;
+    return p;
+}
+
+static int at_end(const char *p) {
+    return p[0] == '\0' || (p[0] == '\n' && p[1] == '\0');
+}
+
+void parse_udp_request(const char *buffer, UdpRequest *req) {
+    const char *p = buffer + 4;
+    int valid;
+
+    req->status = PARSE_ERR;
+    req->type = REQ_UNKNOWN;
+    if (buffer[0] == '\0' || buffer[1] == '\0' || buffer[2] == '\0') return;
+
+    switch (OPCODE(buffer[0], buffer[1], buffer[2])) {
+        case OPCODE('S', 'N', 'G'): req->type = REQ_SNG; break;
+        case OPCODE('T', 'R', 'Y'): req->type = REQ_TRY; break;
+        case OPCODE('Q', 'U', 'T'): req->type = REQ_QUT; break;
+        case OPCODE('D', 'B', 'G'): req->type = REQ_DBG; break;
+        default: return;
+    }
+    if (buffer[3] != ' ' || !(p = parse_plid(p, req))) return;
+
+    switch (req->type) {
+        case REQ_SNG:
+            // SNG PLID time [pegs colours]
+            if (*p++ != ' ' || !(p = parse_number(p, 3, &req->max_playtime))) return;
+            if (req->max_playtime < 1 || req->max_playtime > MAX_PLAYTIME) return;
+            req->shape = SHAPE_4X6;
+            if (!at_end(p)) {
+                int pegs, n_colors;
+                if (*p++ != ' ' || !(p = parse_number(p, 1, &pegs)) ||
+                    *p++ != ' ' || !(p = parse_number(p, 2, &n_colors)) || !at_end(p)) return;
+                if ((req->shape = find_shape(pegs, n_colors)) < 0) return;    // Not a supported shape
+            }
+            break;
+
+        case REQ_TRY:
+            // TRY PLID C1 ... Cn nT
+            if (!(p = parse_code(p, req, &valid))) return;
+            if (*p++ != ' ' || !(p = parse_number(p, 3, &req->trial)) || !at_end(p)) return;
+            if (!valid) {
+                req->status = PARSE_INV;    // Well-formed, but not a code of this game
+                return;
+            }
+            break;
+
+        case REQ_QUT:
+            // QUT PLID
+            if (!at_end(p)) return;
+            break;
+
+        case REQ_DBG:
+            // DBG PLID time C1 ... Cn
+            if (*p++ != ' ' || !(p = parse_number(p, 3, &req->max_playtime))) return;
+            if (req->max_playtime < 1 || req->max_playtime > MAX_PLAYTIME) return;
+            if (!(p = parse_code(p, req, &valid)) || !at_end(p) || !valid) return;
+            break;
+
+        default:
+            return;
+    }
+    req->status = PARSE_OK;
+}
@@ -0,0 +1,46 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+
+#include "feedback.h"
+
+#define MAX_PLAYTIME 600        // Maximum playtime of a game (s)
+
+// 3-letter opcode packed as a 24-bit integer
+#define OPCODE(a, b, c) ((uint32_t)(a) << 16 | (uint32_t)(b) << 8 | (uint32_t)(c))
+
+typedef enum {
+    REQ_UNKNOWN,    // Not a UDP command
+    REQ_SNG,        // SNG PLID time [pegs colours]
+    REQ_TRY,        // TRY PLID C1 ... Cn nT
+    REQ_QUT,        // QUT PLID
+    REQ_DBG         // DBG PLID time C1 ... Cn
+} RequestType;
+
+typedef enum {
+    PARSE_OK,       // Well-formed request
+    PARSE_ERR,      // Syntax error (reply <code> ERR)
+    PARSE_INV       // Well-formed TRY with a letter that is not a colour of its shape (reply RTR INV)
+} ParseStatus;
+
+// Typed UDP request; fields not used by the command are left unset
+typedef struct {
+    RequestType type;
+    ParseStatus status;
+    char plid[7];           // Player ID (6 digits)
+    int key;                // Packed PLID
+    int max_playtime;       // SNG/DBG: 1 to MAX_PLAYTIME
+    int trial;              // TRY: trial number
+    int shape;              // SNG/DBG: shape of the new game; TRY: shape of the guess (see feedback.h)
+    int code;               // TRY: guess, DBG: secret key (index of the code)
+    char colors[MAX_PEGS + 1];  // The same code as letters
+} UdpRequest;
+
+/**
+ * Parse a NUL-terminated datagram in a single pass, without allocating.
+ * The command must end at the last field (optionally followed by a newline).
+ */
+void parse_udp_request(const char *buffer, UdpRequest *req);
+
+#endif
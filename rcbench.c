@@ -0,0 +1,160 @@
+/*
+ * rcbench.c
+ *
+ * Benchmark of crash recovery from GAMES/ (recovery.c), the startup path of a server that
+ * has no snapshot to load. It writes a GAMES/ tree of N in-progress games, in the format the
+ * materializer writes them (a header line and one "T:" line per trial), under a scratch
+ * directory, then times recover_games over it with one scan thread and with -j threads,
+ * restoring the games into a game table as the server does.
+ *
+ * The files have just been written, so the scans read them from the page cache: the times
+ * are those of a restart on a warm machine, dominated by open/parse rather than by the disk.
+ *
+ * Usage: rcbench [-n games] [-t trials] [-j threads] [-d dir] [-k]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "feedback.h"
+#include "game_table.h"
+#include "recovery.h"
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *phase, long ops, double seconds) {
+    printf("%-8s %10ld ops %8.1f ms %10.2f Kops/s %8.1f us/op\n",
+           phase, ops, seconds * 1e3, ops / seconds / 1e3, seconds * 1e6 / ops);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-n games (1-900000)] [-t trials (0-%d)] [-j threads (1-%d)] [-d dir] [-k]\n",
+            name, GAME_MAX_TRIALS - 1, RECOVERY_THREADS);
+    exit(EXIT_FAILURE);
+}
+
+// PLID of the i-th generated game
+static void game_plid(int i, char *plid) {
+    sprintf(plid, "%06u", (100000u + (unsigned)i) % 1000000u);
+}
+
+// Recovered games go into one table, as restore_game puts them into the shards
+static void restore(const RecoveredGame *recovered, void *ctx) {
+    GameTable *table = ctx;
+    Game *game = game_table_insert(table, recovered->game.plid);
+    if (!game) {
+        perror("game_table_insert");
+        exit(EXIT_FAILURE);
+    }
+    *game = recovered->game;
+    *game_history(table, game) = recovered->history;
+}
+
+// Time one scan of the tree and check that every game came back
+static void scan(const char *phase, int threads, long n_games) {
+    GameTable table;
+    if (game_table_init(&table, GAME_TABLE_INITIAL) < 0) {
+        perror("game_table_init");
+        exit(EXIT_FAILURE);
+    }
+    double t0 = now_s();
+    long recovered = recover_games(restore, &table, threads);
+    report(phase, recovered, now_s() - t0);
+    if (recovered != n_games || table.count != (uint32_t)n_games) {
+        fprintf(stderr, "%s: recovered %ld of %ld games\n", phase, recovered, n_games);
+        exit(EXIT_FAILURE);
+    }
+    game_table_free(&table);
+}
+
+int main(int argc, char *argv[]) {
+    int n_games = 100000, n_trials = 4, threads = RECOVERY_THREADS, keep = 0, opt;
+    char scratch[] = "/tmp/rcbench.XXXXXX";
+    const char *dir = NULL;
+    unsigned int seed = 1;
+
+    while ((opt = getopt(argc, argv, "n:t:j:d:k")) != -1) {
+        switch (opt) {
+            case 'n': n_games = atoi(optarg); break;
+            case 't': n_trials = atoi(optarg); break;
+            case 'j': threads = atoi(optarg); break;
+            case 'd': dir = optarg; break;
+            case 'k': keep = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (n_games < 1 || n_games > 900000 || n_trials < 0 || n_trials >= GAME_MAX_TRIALS ||
+        threads < 1 || threads > RECOVERY_THREADS)
+        usage(argv[0]);
+
+    if (!dir && !(dir = mkdtemp(scratch))) {
+        perror("mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    if ((mkdir(dir, 0777) < 0 && errno != EEXIST) || chdir(dir) < 0 || (mkdir("GAMES", 0777) < 0 && errno != EEXIST)) {
+        perror(dir);
+        exit(EXIT_FAILURE);
+    }
+    feedback_init();
+
+    // GAMES/<PLID>/GAME_<PLID>.txt for PLIDs 100000 and up, started a minute ago
+    char plid[7], path[64], secret[N_PEGS + 1], guess[N_PEGS + 1], time_str[20];
+    time_t start = time(NULL) - 60;
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", gmtime(&start));
+    double t0 = now_s();
+    for (int i = 0; i < n_games; i++) {
+        game_plid(i, plid);
+        sprintf(path, "GAMES/%s", plid);
+        if (mkdir(path, 0777) < 0 && errno != EEXIST) {
+            perror(path);
+            exit(EXIT_FAILURE);
+        }
+        sprintf(path, "GAMES/%s/GAME_%s.txt", plid, plid);
+        FILE *file = fopen(path, "w");
+        if (!file) {
+            perror(path);
+            exit(EXIT_FAILURE);
+        }
+        code_colors(SHAPE_4X6, rand_r(&seed) % N_CODES, secret);
+        fprintf(file, "%s %c %s %d %s %ld\n", plid, i % 2 ? 'P' : 'D', secret, 600, time_str, (long)start);
+        for (int t = 0; t < n_trials; t++) {
+            code_colors(SHAPE_4X6, rand_r(&seed) % N_CODES, guess);
+            uint8_t result = feedback(code_index(SHAPE_4X6, secret), code_index(SHAPE_4X6, guess));
+            fprintf(file, "T: %s %d %d %d\n", guess, FEEDBACK_NB(result), FEEDBACK_NW(result), 10 * (t + 1));
+        }
+        fclose(file);
+    }
+    report("write", n_games, now_s() - t0);
+
+    // One thread, then the parallel scan the server runs at startup (capped by the CPUs, as there)
+    scan("scan-1", 1, n_games);
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus > 0 && n_cpus < threads) threads = (int)n_cpus;
+    char phase[16];
+    snprintf(phase, sizeof(phase), "scan-%d", threads);
+    scan(phase, threads, n_games);
+
+    // Remove the tree unless asked to keep it
+    if (!keep) {
+        for (int i = 0; i < n_games; i++) {
+            game_plid(i, plid);
+            sprintf(path, "GAMES/%s/GAME_%s.txt", plid, plid);
+            unlink(path);
+            sprintf(path, "GAMES/%s", plid);
+            rmdir(path);
+        }
+        rmdir("GAMES");
+        if (dir == scratch && chdir("/") == 0) rmdir(dir);
+    }
+    printf("(%d games of %d trials in %s%s)\n", n_games, n_trials, dir, keep ? "" : ", removed");
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * recovery.c
+ *
+ * Crash recovery of in-progress games. The game files are the durable state of a game (the
+ * WAL is replayed into them first), so on startup every GAMES/<PLID>/GAME_<PLID>.txt left by
+ * the previous run describes a game that was still being played. Its header line gives the
+ * mode, secret key, playtime and start time, and each "T:" line one trial.
+ *
+ * Reading thousands of small files is dominated by open/read latency, so the player
+ * directories are split over several threads, each parsing into its own array. The results
+ * are handed to the caller from a single thread, which owns the game tables.
+ */
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "feedback.h"
+#include "recovery.h"
+
+// Work of one scan thread: every n_threads-th player directory, starting at `first`
+typedef struct {
+    pthread_t thread;
+    int running;            // The thread was started (and must be joined)
+    char (*plids)[7];
+    long n_plids;
+    int first, stride;
+    RecoveredGame *games;   // Recovered games
+    long count, cap;
+} ScanJob;
+
+// Parse an active game file; returns 1 if it holds a valid game
+static int parse_game_file(const char *plid, RecoveredGame *recovered) {
+    char fname[64], line[128], header_plid[7], mode, code[MAX_PEGS + 1];
+    long start_time;
+    int max_playtime, shape = -1, secret = -1;
+    Game *game = &recovered->game;
+
+    snprintf(fname, sizeof(fname), "GAMES/%s/GAME_%s.txt", plid, plid);
+    FILE *file = fopen(fname, "r");
+    if (!file) return 0;    // No game in progress
+
+    memset(recovered, 0, sizeof(*recovered));
+    // Header: PLID M CCCC max_playtime YYYY-MM-DD HH:MM:SS start_time
+    if (!fgets(line, sizeof(line), file) ||
+        sscanf(line, "%6s %c %6s %d %*s %*s %ld", header_plid, &mode, code, &max_playtime, &start_time) != 5 ||
+        strcmp(header_plid, plid) != 0 || (shape = shape_of_pegs(strlen(code))) < 0 ||
+        (secret = code_index(shape, code)) < 0 ||
+        start_time < GAME_EPOCH || max_playtime < 0) {
+        fprintf(stderr, "Ignoring malformed game file %s\n", fname);
+        fclose(file);
+        return 0;
+    }
+    game->plid = plid_key(plid);
+    game->shape = shape;
+    game->secret = secret;
+    game->debug = mode == 'D';
+    game->start = game_time(start_time);
+    game->deadline = game->start + max_playtime;
+    game->active = 1;
+
+    // Trials: T: CCCC nB nW s
+    int guess;
+    while (fgets(line, sizeof(line), file) && game->trials < GAME_MAX_TRIALS) {
+        if (sscanf(line, "T: %6s", code) == 1 && strlen(code) == (size_t)game_shapes[shape].pegs &&
+            (guess = code_index(shape, code)) >= 0) {
+            recovered->history.guesses[game->trials++] = guess;
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+static void *scan_thread(void *arg) {
+    ScanJob *job = arg;
+
+    for (long i = job->first; i < job->n_plids; i += job->stride) {
+        if (job->count == job->cap) {
+            long cap = job->cap ? job->cap * 2 : 256;
+            RecoveredGame *grown = realloc(job->games, cap * sizeof(RecoveredGame));
+            if (!grown) {
+                perror("Failed to allocate recovered games");
+                break;
+            }
+            job->games = grown;
+            job->cap = cap;
+        }
+        if (parse_game_file(job->plids[i], &job->games[job->count])) job->count++;
+    }
+    return NULL;
+}
+
+long recover_games(recover_callback restore, void *ctx, int max_threads) {
+    char (*plids)[7] = NULL;
+    long n_plids = 0, cap = 0, recovered = 0;
+    struct dirent *entry;
+
+    // List the player directories
+    DIR *dir = opendir("GAMES");
+    if (!dir) return 0;
+    while ((entry = readdir(dir)) != NULL) {
+        if (plid_key(entry->d_name) < 0) continue;
+        if (n_plids == cap) {
+            cap = cap ? cap * 2 : 1024;
+            char (*grown)[7] = realloc(plids, cap * sizeof(*plids));
+            if (!grown) {
+                perror("Failed to list player directories");
+                break;
+            }
+            plids = grown;
+        }
+        strcpy(plids[n_plids++], entry->d_name);
+    }
+    closedir(dir);
+    if (n_plids == 0) {
+        free(plids);
+        return 0;
+    }
+
+    // Parse the game files in parallel
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int n_threads = n_cpus > 0 && n_cpus < RECOVERY_THREADS ? (int)n_cpus : RECOVERY_THREADS;
+    if (max_threads > 0 && max_threads < n_threads) n_threads = max_threads;
+    if (n_threads > n_plids) n_threads = (int)n_plids;
+
+    ScanJob jobs[RECOVERY_THREADS];
+    memset(jobs, 0, sizeof(jobs));
+    for (int t = 0; t < n_threads; t++) {
+        jobs[t].plids = plids;
+        jobs[t].n_plids = n_plids;
+        jobs[t].first = t;
+        jobs[t].stride = n_threads;
+        jobs[t].running = pthread_create(&jobs[t].thread, NULL, scan_thread, &jobs[t]) == 0;
+        if (!jobs[t].running) scan_thread(&jobs[t]);    // Scan this share inline instead
+    }
+
+    // Hand the games over from this thread
+    for (int t = 0; t < n_threads; t++) {
+        if (jobs[t].running) pthread_join(jobs[t].thread, NULL);
+        for (long i = 0; i < jobs[t].count; i++) restore(&jobs[t].games[i], ctx);
+        recovered += jobs[t].count;
+        free(jobs[t].games);
+    }
+    free(plids);
+    return recovered;
+}
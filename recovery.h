@@ -0,0 +1,28 @@
+#ifndef RECOVERY_H
+#define RECOVERY_H
+
+#include "game_table.h"
+
+#define RECOVERY_THREADS 8      // Max threads scanning GAMES/ at startup
+
+// A game rebuilt from its file
+typedef struct {
+    Game game;
+    GameHistory history;
+} RecoveredGame;
+
+// Called once per recovered game, from the thread that called recover_games
+typedef void (*recover_callback)(const RecoveredGame *recovered, void *ctx);
+
+/**
+ * Find the games that were in progress when the server stopped (GAMES/<PLID>/GAME_<PLID>.txt)
+ * and rebuild their state (mode, secret key, playtime, start time and trials) from the files.
+ * The directories are parsed by up to RECOVERY_THREADS threads; the games are then handed to
+ * `restore` one by one.
+ *
+ * @param max_threads cap on the scan threads (0: one per CPU, up to RECOVERY_THREADS)
+ * @return number of recovered games
+ */
+long recover_games(recover_callback restore, void *ctx, int max_threads);
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * reply_cache.c
+ *
+ * Per-shard cache of the last UDP reply of each player. Clients retransmit a request when
+ * its reply is lost; replaying the stored reply keeps those retransmissions idempotent
+ * (a resent SNG gets its RSG OK, a resent TRY its original nB/nW) and cheap, since neither
+ * the game table nor the write-ahead log is touched.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "game_table.h"
+#include "reply_cache.h"
+
+// Entry of a key
+static ReplyEntry *entry_of(const ReplyCache *cache, uint32_t key) {
+    return &cache->entries[(uint32_t)(key * 2654435761u) >> cache->shift];
+}
+
+int reply_cache_init(ReplyCache *cache) {
+    cache->entries = malloc(REPLY_CACHE_SIZE * sizeof(ReplyEntry));
+    if (!cache->entries) return -1;
+    for (uint32_t i = 0; i < REPLY_CACHE_SIZE; i++) cache->entries[i].key = EMPTY_KEY;
+
+    cache->shift = 32;
+    for (uint32_t size = REPLY_CACHE_SIZE; size > 1; size >>= 1) cache->shift--;
+    return 0;
+}
+
+void reply_cache_free(ReplyCache *cache) {
+    free(cache->entries);
+    cache->entries = NULL;
+}
+
+uint64_t reply_digest(const char *request, size_t len) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)request[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+int reply_cache_lookup(const ReplyCache *cache, uint32_t key, uint64_t digest, char *reply) {
+    const ReplyEntry *entry = entry_of(cache, key);
+    if (entry->key != key || entry->digest != digest) return 0;
+
+    memcpy(reply, entry->reply, entry->len);
+    reply[entry->len] = '\0';
+    return entry->len;
+}
+
+void reply_cache_store(ReplyCache *cache, uint32_t key, uint64_t digest, const char *reply, int len) {
+    ReplyEntry *entry = entry_of(cache, key);
+
+    if (len <= 0 || len >= REPLY_CACHE_REPLY) {
+        if (entry->key == key) entry->key = EMPTY_KEY;
+        return;
+    }
+    entry->key = key;
+    entry->digest = digest;
+    entry->len = len;
+    memcpy(entry->reply, reply, len);
+}
+
+void reply_cache_forget(ReplyCache *cache, uint32_t key) {
+    ReplyEntry *entry = entry_of(cache, key);
+    if (entry->key == key) entry->key = EMPTY_KEY;
+}
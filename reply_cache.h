@@ -0,0 +1,54 @@
+#ifndef REPLY_CACHE_H
+#define REPLY_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define REPLY_CACHE_SIZE 4096       // Entries per worker shard (power of two)
+#define REPLY_CACHE_REPLY 32        // Longest cached reply ("RQT OK R G B Y\n" and the like)
+
+typedef struct {
+    uint32_t key;                   // Packed PLID (EMPTY_KEY if free)
+    uint32_t len;                   // Reply length
+    uint64_t digest;                // Digest of the request that produced the reply
+    char reply[REPLY_CACHE_REPLY];  // Exact reply bytes
+} ReplyEntry;
+
+/*
+ * Last request and reply of each player, per worker shard, so a retransmitted datagram is
+ * answered with the original reply without touching the game state or the disk.
+ * The cache is direct-mapped by PLID: a player's entry is replaced by its next request (or
+ * by another player hashing to the same entry, in which case the request is just processed).
+ */
+typedef struct {
+    ReplyEntry *entries;
+    uint32_t shift;                 // 32 - log2(REPLY_CACHE_SIZE), for multiplicative hashing
+} ReplyCache;
+
+int reply_cache_init(ReplyCache *cache);
+void reply_cache_free(ReplyCache *cache);
+
+/**
+ * Digest of a request datagram (64-bit FNV-1a).
+ */
+uint64_t reply_digest(const char *request, size_t len);
+
+/**
+ * Look up the reply to a player's last request.
+ *
+ * @return the reply length, copied into `reply`, or 0 if this is not a repeat of that request
+ */
+int reply_cache_lookup(const ReplyCache *cache, uint32_t key, uint64_t digest, char *reply);
+
+/**
+ * Remember the reply to a player's request, replacing the previous one (replies too long
+ * to cache just clear the player's entry).
+ */
+void reply_cache_store(ReplyCache *cache, uint32_t key, uint64_t digest, const char *reply, int len);
+
+/**
+ * Forget a player's last reply, when its game changes without a request (timeout).
+ */
+void reply_cache_forget(ReplyCache *cache, uint32_t key);
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ * rscheck.c
+ *
+ * Restart check of the materializer's WAL replay. It runs a Game Server in a scratch
+ * directory and plays two games of one player that end up in the same WAL segment: a first
+ * one started, tried and quit (archived as GAMES/<PLID>/<date>_<time>_Q.txt), then a second
+ * one started and tried twice (GAMES/<PLID>/GAME_<PLID>.txt). Once both are materialized the
+ * server is killed with SIGKILL and restarted, which replays the whole segment over files that
+ * already hold its records.
+ *
+ * The replay must leave both files as they were: the first game's records must not be applied
+ * to the second game's file, nor its end renamed over the archive. The second game must still
+ * be in progress, and take its third trial.
+ *
+ * Usage: rscheck [-s server] [-p GSport] [-d dir]
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <ftw.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define PLID "111111"
+#define GAME_FILE "GAMES/" PLID "/GAME_" PLID ".txt"
+#define FILE_SIZE 4096
+
+static const char *server = "./GS";
+static const char *port = "58053";
+static int udp_socket = -1;
+static struct sockaddr_in server_addr;
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-s server] [-p GSport] [-d dir]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+static pid_t start_server(void) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        execl(server, server, "-p", port, (char *)NULL);
+        perror(server);
+        _exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+// Send a request and return its reply ("" if there was none within 200 ms)
+static const char *request(const char *message, char *reply, size_t size) {
+    sendto(udp_socket, message, strlen(message), 0, (struct sockaddr *)&server_addr, sizeof(server_addr));
+    ssize_t n = recv(udp_socket, reply, size - 1, 0);
+    reply[n > 0 ? n : 0] = '\0';
+    return reply;
+}
+
+// Send a request until the server answers it, for up to 5 s (it may still be starting)
+static void expect(const char *message, const char *expected) {
+    char reply[128];
+    for (int i = 0; i < 25; i++) {
+        if (request(message, reply, sizeof(reply))[0]) break;
+    }
+    if (strcmp(reply, expected) != 0) {
+        fprintf(stderr, "%.*s: expected %.*s, got \"%.*s\"\n", (int)strcspn(message, "\n"), message,
+                (int)strcspn(expected, "\n"), expected, (int)strcspn(reply, "\n"), reply);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int read_file(const char *path, char *buf) {
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+    size_t n = fread(buf, 1, FILE_SIZE - 1, file);
+    buf[n] = '\0';
+    fclose(file);
+    return 0;
+}
+
+// Wait until the game file holds `trials` trials, as the materializer writes them
+static void wait_trials(int trials) {
+    char buf[FILE_SIZE];
+    for (int i = 0; i < 100; i++) {
+        int found = 0;
+        if (read_file(GAME_FILE, buf) == 0) {
+            for (char *line = strstr(buf, "\nT:"); line; line = strstr(line + 1, "\nT:")) found++;
+        }
+        if (found >= trials) return;
+        usleep(50000);
+    }
+    fprintf(stderr, "%s: %d trials not materialized\n", GAME_FILE, trials);
+    exit(EXIT_FAILURE);
+}
+
+// Path of the first game's archive
+static void find_archive(char *path) {
+    DIR *dir = opendir("GAMES/" PLID);
+    struct dirent *entry;
+    path[0] = '\0';
+    while (dir && (entry = readdir(dir))) {
+        size_t len = strlen(entry->d_name);
+        if (len > 6 && strcmp(entry->d_name + len - 6, "_Q.txt") == 0) sprintf(path, "GAMES/" PLID "/%s", entry->d_name);
+    }
+    if (dir) closedir(dir);
+    if (!path[0]) {
+        fprintf(stderr, "GAMES/" PLID ": no archive of the quit game\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st, (void)flag, (void)ftw;
+    return remove(path);
+}
+
+int main(int argc, char *argv[]) {
+    char scratch[] = "/tmp/rscheck.XXXXXX", server_path[PATH_MAX];
+    const char *dir = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:p:d:")) != -1) {
+        switch (opt) {
+            case 's': server = optarg; break;
+            case 'p': port = optarg; break;
+            case 'd': dir = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (atoi(port) <= 0 || atoi(port) > 65535) usage(argv[0]);
+
+    // The server runs in the scratch directory, where it keeps GAMES/, SCORES/ and WAL/
+    if (!realpath(server, server_path)) {
+        perror(server);
+        exit(EXIT_FAILURE);
+    }
+    server = server_path;
+    if (!dir && !(dir = mkdtemp(scratch))) {
+        perror("mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    if ((mkdir(dir, 0777) < 0 && errno != EEXIST) || chdir(dir) < 0) {
+        perror(dir);
+        exit(EXIT_FAILURE);
+    }
+
+    struct timeval timeout = {0, 200000};
+    if ((udp_socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+        setsockopt(udp_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+        perror("UDP socket");
+        exit(EXIT_FAILURE);
+    }
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server_addr.sin_port = htons(atoi(port));
+
+    // Two games of the player, the second one still in progress
+    pid_t pid = start_server();
+    expect("DBG " PLID " 100 R G B Y\n", "RDB OK\n");
+    expect("TRY " PLID " R R G G 1\n", "RTR OK 1 1 1\n");
+    expect("QUT " PLID "\n", "RQT OK R G B Y\n");
+    expect("DBG " PLID " 200 G G G G\n", "RDB OK\n");
+    expect("TRY " PLID " R R R R 1\n", "RTR OK 1 0 0\n");
+    expect("TRY " PLID " G B B B 2\n", "RTR OK 2 1 0\n");
+    wait_trials(2);
+
+    char archive[PATH_MAX], archived[FILE_SIZE], game[FILE_SIZE], after[FILE_SIZE];
+    find_archive(archive);
+    if (read_file(archive, archived) < 0 || read_file(GAME_FILE, game) < 0) {
+        perror("read");
+        exit(EXIT_FAILURE);
+    }
+
+    // Crash, restart, and play the third trial: once it is in the file, the replay is over
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    pid = start_server();
+    expect("TRY " PLID " B B B B 3\n", "RTR OK 3 0 0\n");
+    wait_trials(3);
+
+    int failures = 0;
+    if (read_file(archive, after) < 0 || strcmp(after, archived) != 0) {
+        fprintf(stderr, "%s changed by the replay:\n%s\n", archive, after);
+        failures++;
+    }
+    // The second game's file gains the third trial, and nothing else
+    const char *added = after + strlen(game);
+    if (read_file(GAME_FILE, after) < 0 || strncmp(after, game, strlen(game)) != 0 ||
+        strncmp(added, "T: BBBB ", 8) != 0 || strchr(added, '\n') != strrchr(added, '\n')) {
+        fprintf(stderr, "%s changed by the replay:\n%s\n", GAME_FILE, after);
+        failures++;
+    }
+
+    kill(pid, SIGINT);
+    waitpid(pid, NULL, 0);
+    if (chdir("/") == 0 && dir == scratch) nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    printf("%s\n", failures ? "FAILED" : "OK: both games intact after the restart");
+    return failures ? EXIT_FAILURE : 0;
+}
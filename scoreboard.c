@@ -0,0 +1,133 @@
+/*
+ * scoreboard.c
+ *
+ * In-memory top 10 of the SCORES directory. The directory is scanned once at startup, unless
+ * the top 10 comes from a snapshot (see snapshot.c); after that every new score file is offered
+ * to scoreboard_add(), which keeps a sorted array of the best 10 entries and a pre-serialized
+ * RSS reply. SSB only copies that reply, so its cost no
+ * longer depends on how many games have ever been won.
+ *
+ * The ranking is the one the scandir/alphasort implementation produced: score files sorted
+ * by name, highest first. Entries are added by the materializer thread and read by the TCP
+ * thread, so the state is protected by a mutex.
+ */
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "scoreboard.h"
+
+static ScoreEntry top[TOP_SCORES];
+static int n_top = 0;
+
+// Cached SSB reply, rebuilt when the top 10 changes
+static char response[SCOREBOARD_BUFFER] = "RSS EMPTY\n";
+static int response_len = 10;
+
+static pthread_mutex_t scoreboard_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Serialize the top 10 as the scoreboard.txt payload of an RSS reply
+static void rebuild_response(void) {
+    char data[SCOREBOARD_BUFFER - 64];
+    int len = 0;
+
+    if (n_top == 0) {
+        response_len = snprintf(response, sizeof(response), "RSS EMPTY\n");
+        return;
+    }
+    for (int i = 0; i < n_top; i++) {
+        len += snprintf(data + len, sizeof(data) - len, "%03d %s %s %d %s\n",
+                        top[i].score, top[i].plid, top[i].code, top[i].trials, top[i].mode);
+    }
+    response_len = snprintf(response, sizeof(response), "RSS OK scoreboard.txt %d %s", len, data);
+}
+
+// Insert an entry in rank order; returns 1 if the top 10 changed
+static int insert(const ScoreEntry *entry) {
+    int pos = n_top;
+
+    for (int i = 0; i < n_top; i++) {
+        int cmp = strcmp(entry->key, top[i].key);
+        if (cmp == 0) return 0;     // Already ranked (e.g. a score file rewritten by WAL replay)
+        if (cmp > 0 && pos == n_top) pos = i;
+    }
+    if (pos >= TOP_SCORES) return 0;
+
+    if (n_top < TOP_SCORES) n_top++;
+    memmove(&top[pos + 1], &top[pos], (n_top - 1 - pos) * sizeof(ScoreEntry));
+    top[pos] = *entry;
+    return 1;
+}
+
+int scoreboard_load(void) {
+    DIR *dir = opendir("SCORES");
+    struct dirent *entry;
+    char fname[300];
+
+    if (!dir) return 0;
+
+    pthread_mutex_lock(&scoreboard_mutex);
+    while ((entry = readdir(dir)) != NULL) {
+        ScoreEntry score;
+        int file_score;
+        char file_plid[7];
+
+        // Only score files (SSS_PLID_DDMMYYYY_HHMMSS.txt) take part in the ranking
+        if (sscanf(entry->d_name, "%3d_%6[0-9]_", &file_score, file_plid) != 2) continue;
+        if (strlen(entry->d_name) >= sizeof(score.key)) continue;
+
+        snprintf(fname, sizeof(fname), "SCORES/%s", entry->d_name);
+        FILE *file = fopen(fname, "r");
+        if (!file) {
+            perror("Failed to open score file for reading");
+            continue;
+        }
+        int fields = fscanf(file, "%d %6s %6s %d %5s", &score.score, score.plid, score.code, &score.trials, score.mode);
+        fclose(file);
+        if (fields != 5) continue;
+
+        strcpy(score.key, entry->d_name);
+        insert(&score);
+    }
+    closedir(dir);
+
+    rebuild_response();
+    int n = n_top;
+    pthread_mutex_unlock(&scoreboard_mutex);
+    return n;
+}
+
+void scoreboard_add(const char *key, int score, const char *plid, const char *code, int trials, const char *mode) {
+    ScoreEntry entry;
+
+    memset(&entry, 0, sizeof(entry));
+    snprintf(entry.key, sizeof(entry.key), "%s", key);
+    entry.score = score;
+    snprintf(entry.plid, sizeof(entry.plid), "%s", plid);
+    snprintf(entry.code, sizeof(entry.code), "%s", code);
+    entry.trials = trials;
+    snprintf(entry.mode, sizeof(entry.mode), "%s", mode);
+
+    pthread_mutex_lock(&scoreboard_mutex);
+    if (insert(&entry)) rebuild_response();
+    pthread_mutex_unlock(&scoreboard_mutex);
+}
+
+int scoreboard_copy(ScoreEntry *entries) {
+    pthread_mutex_lock(&scoreboard_mutex);
+    int n = n_top;
+    memcpy(entries, top, n * sizeof(ScoreEntry));
+    pthread_mutex_unlock(&scoreboard_mutex);
+    return n;
+}
+
+int scoreboard_response(char *buffer, int size) {
+    pthread_mutex_lock(&scoreboard_mutex);
+    int len = response_len < size - 1 ? response_len : size - 1;
+    memcpy(buffer, response, len);
+    buffer[len] = '\0';
+    pthread_mutex_unlock(&scoreboard_mutex);
+    return len;
+}
@@ -0,0 +1,44 @@
+#ifndef SCOREBOARD_H
+#define SCOREBOARD_H
+
+#define TOP_SCORES 10
+#define SCOREBOARD_BUFFER 1024
+
+// One entry of the top 10
+typedef struct {
+    char key[32];       // Score file name, which defines the ranking (SSS_PLID_DDMMYYYY_HHMMSS.txt)
+    int score;          // Game score
+    char plid[7];       // Player ID
+    char code[7];       // Secret key (4 to 6 colours)
+    int trials;         // Number of trials made in the game
+    char mode[6];       // Game mode (PLAY or DEBUG)
+} ScoreEntry;
+
+/**
+ * Load the best scores from the SCORES directory. Called once at startup.
+ *
+ * @return number of entries in the top 10
+ */
+int scoreboard_load(void);
+
+/**
+ * Offer a new score (called whenever a score file is created). The cached RSS reply is only
+ * rebuilt if the entry makes it into the top 10.
+ */
+void scoreboard_add(const char *key, int score, const char *plid, const char *code, int trials, const char *mode);
+
+/**
+ * Copy the top 10 (for a snapshot).
+ *
+ * @return number of entries copied
+ */
+int scoreboard_copy(ScoreEntry *entries);
+
+/**
+ * Copy the cached SSB reply ("RSS OK scoreboard.txt <size> <data>" or "RSS EMPTY\n").
+ *
+ * @return length of the reply
+ */
+int scoreboard_response(char *buffer, int size);
+
+#endif
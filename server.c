@@ -2,29 +2,145 @@
  * server.c
  * 
  * This is a combined server for handling both UDP and TCP connections in a simple Mastermind-style game. 
- * It uses select to manage multiple clients at the same time without blocking.
+ * It uses an edge-triggered epoll loop to manage multiple clients at the same time without blocking.
  * 
  * What it does:
  * - Handles UDP commands like starting a game (SNG), making guesses (TRY), and quitting (QUT).
+ *   SNG may ask for another shape than 4 pegs x 6 colours ("SNG PLID time 5 8"; see feedback.h),
+ *   and DBG/TRY codes have one colour per peg of their game.
  * - Handles TCP requests for things like getting trial summaries (STR) and the scoreboard (SSB).
+ *   A client may opt in with KAL to keep its connection open for several (pipelined) requests;
+ *   connections without traffic are closed after TCP_IDLE_TIMEOUT seconds.
  * - Keeps track of active games, generates secret keys, and manages game state for multiple players.
+ * - Spreads UDP traffic over N worker threads (-w), each with its own SO_REUSEPORT socket and its own
+ *   shard of games; a BPF steering program keeps every PLID on the same worker, so no locking is needed.
+ * - Moves datagrams in batches (-b) with recvmmsg/sendmmsg: one syscall each way per batch.
+ * - Optionally (-u) runs the workers on io_uring instead: a multishot receive into provided buffers
+ *   and one SENDMSG per reply, all submitted and reaped with one io_uring_enter per wakeup
+ *   (falls back to epoll when the kernel lacks support).
+ * - Logs game events to a per-worker write-ahead log: workers queue fixed-size records on a lock-free
+ *   ring and a log writer thread does all the writes (group commit every -f ms); a materializer
+ *   thread turns the log into the GAMES/ and SCORES/ files in the background. An STR waits (without
+ *   blocking the TCP loop) until the files show every event its player's worker had logged.
+ * - With -v, request-path messages go to per-thread rings (see vlog.c) and are formatted and written
+ *   by a background thread; messages that find a ring full are dropped and counted.
+ * - Every -s seconds, pauses the workers between two requests and forks a child that writes a snapshot
+ *   of the games, reply caches and top 10 (see snapshot.c); log segments are deleted once they are
+ *   both materialized and covered by a snapshot.
+ * - On SIGINT/SIGTERM, stops the workers, drains the rings, applies the logs and writes a last
+ *   snapshot before exiting.
+ * - Keeps the top 10 scores in memory, so SSB is answered from a cached reply.
+ * - On startup, maps the latest snapshot and replays only the log records written after it; without
+ *   a snapshot, rebuilds the games that were in progress from GAMES/ (see recovery.c).
  * 
- * The server supports up to MAX_CLIENTS and responds to each client based on their requests.
+ * Each worker keeps its games in a hash table keyed by PLID that grows on demand, finalizes timed-out
+ * games from a timing wheel driven by its event loop, and responds to each client based on their requests.
  */
 
 
+#define _GNU_SOURCE     // accept4, recvmmsg/sendmmsg, pthread_setaffinity_np
 #include "server.h"
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+
+// Active games of the calling worker's shard (each UDP worker owns its own table)
+__thread GameTable *active_games;
+
+// Expiry timers of the calling worker's games (indexed by game slot)
+__thread TimerWheel *game_timers;
+
+// Queue of the calling worker's log records (drained by the log writer)
+__thread LogRing *game_log;
+
+// Last reply to each player of the calling worker's shard, and the worker's counters
+__thread ReplyCache *reply_cache;
+__thread Metrics *shard_metrics;
+
+__thread char formatted_key[SECRET_KEY_SIZE];
+
+// Per-worker seed for the secret key generator
+__thread unsigned int key_seed;
+
+// UDP workers, one per SO_REUSEPORT socket
+Worker *workers = NULL;
+int n_workers = 1;
+
+// Datagrams moved per recvmmsg/sendmmsg call
+int udp_batch_size = UDP_BATCH;
+
+// Run the UDP workers on io_uring (-u), when the kernel supports it
+int use_uring = 0;
+
+// WAL group commit interval (ms)
+int wal_fsync_interval = WAL_FSYNC_INTERVAL;
+
+// First log segment of this run (numbers continue from the previous run's segments and snapshot)
+uint32_t wal_first_segment = 0;
+
+// Log writer: drains the workers' rings into the WAL, sleeping on an eventfd when idle
+pthread_t log_writer_thread;
+int log_writer_fd = -1;
+atomic_int log_writer_idle = 0;
+atomic_int log_writer_stop = 0;
+atomic_int log_writer_drain = 0;    // Set by a snapshot, cleared by the next round that drained every ring
+
+// Shutdown (SIGINT/SIGTERM): the signal handler sets the flag, the eventfd wakes the workers
+volatile sig_atomic_t stop_requested = 0;
+int shutdown_fd = -1;
+
+// Snapshots (-s): the eventfd sends the workers to the barrier, where they wait for the fork
+int snapshot_interval = SNAPSHOT_INTERVAL;
+int snapshot_fd = -1;
+pthread_barrier_t snapshot_barrier;
+pid_t snapshot_child = -1;                  // Child writing the latest snapshot
+uint32_t snapshot_retain[MAX_WORKERS];      // Oldest segment of each log that snapshot still needs
+uint64_t snapshot_logged = 0;               // Records the workers had logged when it was taken
+
+// Log positions of the snapshot loaded at startup: only the records from there on are restored
+// into the tables
+int snapshot_loaded = 0;
+uint64_t replay_from[WAL_MAX_SHARDS];
+
+// Materializer wake-up
+pthread_t materializer_thread;
+pthread_mutex_t materializer_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t materializer_cond = PTHREAD_COND_INITIALIZER;
+int materializer_pending = 0;
+int materializer_stop = 0;
+int materializer_catch_up = 0;      // Apply the previous run's segments (below wal_first_segment) first
+int leftovers_covered = 0;          // The startup snapshot covers them: delete them once applied
 
-// Array to store active games for all connected clients
-Game active_games[MAX_CLIENTS];
+int verbose = 0;
 
-char formatted_key[10];
+// Counters of the TCP requests (updated by the main thread only)
+Metrics tcp_metrics;
 
-int verbose = 0;
+// Open TCP connections, indexed by socket fd
+Connection **connections = NULL;
+int connections_cap = 0;
+
+// Idle timeouts of the TCP connections (indexed by socket fd, main thread only)
+TimerWheel idle_timers;
+
+// STRs held until the materializer catches up (main thread only), how many there are, and the
+// eventfd the materializer wakes the TCP loop with while there are any
+Connection *waiting_connections = NULL;
+atomic_int tcp_waiting = 0;
+int materialized_fd = -1;
 
 // ====================== Create files ======================
 
@@ -43,22 +159,114 @@ void create_directories() {
     } else {
          if (verbose) printf("Directory SCORES created successfully.\n");
     }
+
+    // Write-ahead log segments (kept from a previous run if it did not materialize them)
+    if (mkdir(WAL_DIR, 0777) == -1 && errno != EEXIST) {
+        perror("Failed to create directory " WAL_DIR);
+    }
 }
 
 /* ---------------- GAMES ---------------- */ 
-// Function to create the initial game state file
+// The request path only queues records for the log writer, which appends them to the shard's
+// write-ahead log; the files under GAMES/ and SCORES/ are produced from those records by the
+// materializer thread.
+
+// Queue a record for the calling worker's log
+void log_record(WalRecord *record) {
+    if (log_ring_push(game_log, record) == 0) return;
+
+    // Ring full: the disk is behind. Wait for room rather than lose the event; the worker
+    // stops reading datagrams meanwhile, so the backpressure reaches the socket buffer.
+    uint64_t waiting_since = now_ns();
+    struct timespec pause = {0, 100000};
+    counter_add(&shard_metrics->log_stalls, 1);
+    do {
+        notify_log_writer();
+        nanosleep(&pause, NULL);
+    } while (log_ring_push(game_log, record) < 0);
+    counter_add(&shard_metrics->log_stall_ns, now_ns() - waiting_since);
+}
+
+// Log the creation of a game (materialized as the initial game state file)
 void create_game_file(const char *plid, char mode, const char *code, int max_time) {
+    WalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type = WAL_START;
+    record.mode = mode;
+    strcpy(record.plid, plid);
+    strcpy(record.code, code);
+    record.max_playtime = max_time;
+    Game *game = game_table_find(active_games, plid_key(plid));
+    record.time = game ? game_start(game) : time(NULL);    // The start the game file is matched by
+    log_record(&record);
+}
+
+
+// Log a trial (materialized as a line appended to the game file)
+void add_trial(const char *plid, int trial, const char *guess, int correct_pos, int wrong_pos, int elapsed_time) {
+    WalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type = WAL_TRIAL;
+    record.trials = trial;
+    record.nB = correct_pos;
+    record.nW = wrong_pos;
+    strcpy(record.plid, plid);
+    strcpy(record.code, guess);
+    record.elapsed = elapsed_time;
+    Game *game = game_table_find(active_games, plid_key(plid));
+    if (game) record.time = game_start(game);   // Ties the trial to its game file on replay
+    log_record(&record);
+}
+
+
+// Function to finalize the game: log its end (materialized as the final line, the rename
+// and the score file) and release it from the shard
+void finish_game(const char *plid, const char *end_code) {
+    int key = plid_key(plid);
+    Game *game = key < 0 ? NULL : game_table_find(active_games, key);
+    if (!game) return;
+
+    WalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type = WAL_FINISH;
+    record.mode = game->debug ? 'D' : 'P';
+    record.end_code = end_code[0];
+    record.trials = game->trials;
+    strcpy(record.plid, plid);
+    code_colors(game->shape, game->secret, record.code);
+    record.max_playtime = game_playtime(game);
+    record.time = time(NULL);
+    record.elapsed = (int)difftime(record.time, game_start(game));  // Calcular a duração do jogo
+    if (verbose) vlog("game duration: %d\n", record.elapsed);
+    game->active = 0; // Finalizar o jogo
+    log_record(&record);
+
+    // Release the game's slot in the shard (and its expiry timer)
+    timer_wheel_remove(game_timers, game_slot(active_games, game));
+    game_table_remove(active_games, key);
+}
+
+
+// ====================== Materializer ======================
+
+// Write the initial game state file
+void materialize_start(const WalRecord *record, int recovering) {
     char game_dir[100], filename[150];
 
     // Criar o diretório GAMES/<PLID>
-    sprintf(game_dir, "GAMES/%s", plid);
+    sprintf(game_dir, "GAMES/%s", record->plid);
     if (mkdir(game_dir, 0777) == -1 && errno != EEXIST) {
         perror("Failed to create player directory");
         return;
     }
 
     // Criar o nome do arquivo GAME_<PLID>.txt
-    sprintf(filename, "%s/GAME_%s.txt", game_dir, plid);
+    sprintf(filename, "%s/GAME_%s.txt", game_dir, record->plid);
+
+    // A replayed start may already have been written, and extended by its trials, before the
+    // restart; a file of another game (a later one of the player) is rewritten, as the replay
+    // brings that game's records after this one's
+    if (recovering && game_file_matches(filename, record->time, record->code)) return;
 
     // Abrir o arquivo para escrita
     FILE *file = fopen(filename, "w");
@@ -67,25 +275,54 @@ void create_game_file(const char *plid, char mode, const char *code, int max_tim
         return;
     }
 
-    // Obter o timestamp atual
-    time_t current_time = time(NULL);
-    struct tm *tm_info = gmtime(&current_time);
-
     // Formatar o timestamp
+    time_t start_time = record->time;
+    struct tm *tm_info = gmtime(&start_time);
     char time_str[20];
     strftime(time_str, 20, "%Y-%m-%d %H:%M:%S", tm_info);
 
     // Escrever o estado inicial do jogo
-    fprintf(file, "%s %c %s %d %s %ld\n", plid, mode, code, max_time, time_str, current_time);
+    fprintf(file, "%s %c %s %d %s %ld\n", record->plid, record->mode, record->code, record->max_playtime, time_str, start_time);
     fclose(file); // Fechar o arquivo
-    if (verbose) printf("Game file created: %s\n", filename);
+    if (verbose) vlog("Game file created: %s\n", filename);
+}
+
+// Whether a game file belongs to the game of a replayed record: the same start time, and the
+// same secret key unless `secret` is NULL (a trial only carries the start of its game)
+int game_file_matches(const char *filename, time_t start, const char *secret) {
+    char line[100], code[7];
+    long file_start;
+    FILE *file = fopen(filename, "r");
+    if (!file) return 0;
+    int matches = fgets(line, sizeof(line), file) &&
+                  sscanf(line, "%*s %*c %6s %*d %*s %*s %ld", code, &file_start) == 2 &&
+                  file_start == (long)start && (!secret || strcmp(code, secret) == 0);
+    fclose(file);
+    return matches;
 }
 
+// Number of trials already in a game file
+int count_trials(const char *filename) {
+    char line[100];
+    int trials = 0;
+    FILE *file = fopen(filename, "r");
+    if (!file) return 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "T:", 2) == 0) trials++;
+    }
+    fclose(file);
+    return trials;
+}
 
-// Function to append a trial to the game file
-void add_trial(const char *plid, const char *guess, int correct_pos, int wrong_pos, int elapsed_time) {
+// Append a trial to the game file
+void materialize_trial(const WalRecord *record, int recovering) {
     char filename[50];
-    sprintf(filename, "GAMES/%s/GAME_%s.txt", plid, plid); // Format the filename based on PLID
+    sprintf(filename, "GAMES/%s/GAME_%s.txt", record->plid, record->plid); // Format the filename based on PLID
+
+    // A replayed trial may already have been written before the restart, or belong to a game
+    // that has ended since (its file was renamed, and the player may have started another one)
+    if (recovering && (!game_file_matches(filename, record->time, NULL) || count_trials(filename) >= record->trials))
+        return;
 
     // Open the file in append mode
     FILE *file = fopen(filename, "a");
@@ -95,33 +332,34 @@ void add_trial(const char *plid, const char *guess, int correct_pos, int wrong_p
     }
 
     // Write the trial data to the file (Format => T: CCCC B W s)
-    fprintf(file, "T: %s %d %d %d\n", guess, correct_pos, wrong_pos, elapsed_time);
+    fprintf(file, "T: %s %d %d %d\n", record->code, record->nB, record->nW, record->elapsed);
     fclose(file);
-    if (verbose) printf("Trial added to game file: %s\n", filename);
+    if (verbose) vlog("Trial added to game file: %s\n", filename);
 }
 
-
-// Function to finalize the game, move its file, and rename it
-void finish_game(const char *plid, const char *end_code) {
+// Append the final line to the game file, rename it, and record the score of a win
+void materialize_finish(const WalRecord *record, int recovering) {
     char game_dir[100], current_filename[150], final_filename[150];
     char final_date[9], final_time[7];
-    int game_duration = 0, i = 0;
-    // Obter a data e a hora atuais
-    time_t current_time = time(NULL);
-    struct tm *tm_info = gmtime(&current_time);
+    time_t end_time = record->time;
+    struct tm *tm_info = gmtime(&end_time);
 
     // Formatar a data e a hora
     strftime(final_date, sizeof(final_date), "%Y%m%d", tm_info); // Formato: YYYYMMDD
     strftime(final_time, sizeof(final_time), "%H%M%S", tm_info); // Formato: HHMMSS
 
     // Diretório do jogador
-    sprintf(game_dir, "GAMES/%s", plid);
+    sprintf(game_dir, "GAMES/%s", record->plid);
 
     // Nome do arquivo atual (GAME_<PLID>.txt)
-    sprintf(current_filename, "%s/GAME_%s.txt", game_dir, plid);
+    sprintf(current_filename, "%s/GAME_%s.txt", game_dir, record->plid);
 
     // Nome do arquivo final (YYYYMMDD_HHMMSS_(code).txt)
-    sprintf(final_filename, "%s/%s_%s_%s.txt", game_dir, final_date, final_time, end_code);
+    sprintf(final_filename, "%s/%s_%s_%c.txt", game_dir, final_date, final_time, record->end_code);
+
+    // A replayed end may already have been applied before the restart (the file is gone, or is
+    // the file of a later game of the player)
+    if (recovering && !game_file_matches(current_filename, end_time - record->elapsed, record->code)) return;
 
     // Abrir o arquivo atual para adicionar a última linha
     FILE *file = fopen(current_filename, "a");
@@ -130,19 +368,8 @@ void finish_game(const char *plid, const char *end_code) {
         char final_date_time[20];
         strftime(final_date_time, sizeof(final_date_time), "%Y-%m-%d %H:%M:%S", tm_info);
 
-        // Calcular a duração do jogo
-
-        for (i = 0; i < MAX_CLIENTS; i++) {
-            if (strcmp(active_games[i].plid, plid) == 0) {
-                game_duration = (int)difftime(current_time, active_games[i].start_time);
-                active_games[i].active = 0; // Finalizar o jogo
-                break;
-            }
-        }
-        if (verbose) printf("game duration: %d\n", game_duration);
-
         // Escrever a última linha no arquivo
-        fprintf(file, "%s %d\n", final_date_time, game_duration);
+        fprintf(file, "%s %d\n", final_date_time, record->elapsed);
         fclose(file);
     } else {
         perror("Failed to append to game file");
@@ -150,24 +377,273 @@ void finish_game(const char *plid, const char *end_code) {
 
     // Renomear o arquivo para o formato final
     if (rename(current_filename, final_filename) == 0) {
-        if (verbose) printf("Game file renamed to: %s\n", final_filename);
+        struct stat st;
+        player_index_record(record->plid, final_filename + strlen(game_dir) + 1,
+                            stat(final_filename, &st) == 0 ? (uint32_t)st.st_size : 0);
+        if (verbose) vlog("Game file renamed to: %s\n", final_filename);
     } else {
         perror("Failed to rename game file");
     }
-    if (strncmp(end_code, "W", 1) == 0) {
-        create_score_file(plid, active_games[i].secret_key, active_games[i].trials, active_games[i].mode, game_duration, active_games[i].max_playtime);
+    if (record->end_code == 'W') {
+        create_score_file(record->plid, record->code, record->trials, record->mode == 'D' ? "DEBUG" : "PLAY",
+                          record->elapsed, record->max_playtime, end_time);
+    }
+}
+
+// Apply one logged event to the files
+void materialize_record(const WalRecord *record, int recovering) {
+    switch (record->type) {
+        case WAL_START:
+            materialize_start(record, recovering);
+            break;
+        case WAL_TRIAL:
+            materialize_trial(record, recovering);
+            break;
+        case WAL_FINISH:
+            materialize_finish(record, recovering);
+            break;
+        default:
+            fprintf(stderr, "Unknown WAL record type %d\n", record->type);
+            break;
+    }
+}
+
+// Wake the materializer after a worker wrote new records
+void notify_materializer() {
+    pthread_mutex_lock(&materializer_mutex);
+    materializer_pending = 1;
+    pthread_cond_signal(&materializer_cond);
+    pthread_mutex_unlock(&materializer_mutex);
+}
+
+// Let the TCP loop serve the STRs that were waiting for the records just applied
+void notify_tcp_waiting(void) {
+    uint64_t one = 1;
+    if (atomic_load(&tcp_waiting) && write(materialized_fd, &one, sizeof(one)) < 0) perror("Failed to wake the TCP loop");
+}
+
+// Wake the log writer if it is asleep (called by the workers after queueing records)
+void notify_log_writer(void) {
+    uint64_t one = 1;
+
+    // Pairs with the writer's fence between raising its idle flag and its last look at the rings
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&log_writer_idle, memory_order_relaxed) && write(log_writer_fd, &one, sizeof(one)) < 0)
+        perror("Failed to wake the log writer");
+}
+
+// Whether every worker's ring is empty
+static int log_rings_empty(void) {
+    for (int i = 0; i < n_workers; i++) {
+        if (!log_ring_empty(&workers[i].log_ring)) return 0;
+    }
+    return 1;
+}
+
+// Log writer thread: move the queued records of every shard to its log with one write per
+// round, fdatasync once per group commit interval, and hand the new records to the materializer.
+// On shutdown it drains what the (stopped) workers queued and leaves every log durable.
+void *log_writer(void *arg) {
+    (void)arg;
+    WalRecord record;
+
+    while (1) {
+        // Read the flags first: once one is set the workers have stopped or paused, so this round drains everything
+        int stopping = atomic_load(&log_writer_stop);
+        int draining = atomic_load(&log_writer_drain);
+        int written = 0;
+
+        for (int i = 0; i < n_workers; i++) {
+            Worker *worker = &workers[i];
+            while (log_ring_pop(&worker->log_ring, &record)) {
+                if (wal_append(&worker->wal, &record) < 0) {
+                    fprintf(stderr, "Failed to log %s event\n", record.plid);
+                    atomic_fetch_add(&worker->materialized, 1);     // It will never reach the files: no STR waits for it
+                }
+            }
+            if (wal_flush(&worker->wal) > 0) written = 1;
+            wal_sync(&worker->wal, wal_fsync_interval);
+        }
+        if (written) notify_materializer();
+        if (draining) atomic_store(&log_writer_drain, 0);
+        if (stopping) break;
+
+        // Sleep until a worker queues records or a log is due for its group commit
+        int timeout = -1;
+        for (int i = 0; i < n_workers; i++) {
+            int sync_timeout = wal_sync_timeout(&workers[i].wal, wal_fsync_interval);
+            if (sync_timeout >= 0 && (timeout < 0 || sync_timeout < timeout)) timeout = sync_timeout;
+        }
+        atomic_store(&log_writer_idle, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (log_rings_empty() && !atomic_load(&log_writer_stop) && !atomic_load(&log_writer_drain)) {
+            struct pollfd wake = { .fd = log_writer_fd, .events = POLLIN };
+            uint64_t count;
+            if (poll(&wake, 1, timeout) > 0 && read(log_writer_fd, &count, sizeof(count)) < 0) perror("log writer eventfd");
+        }
+        atomic_store(&log_writer_idle, 0);
+    }
+
+    for (int i = 0; i < n_workers; i++) wal_close(&workers[i].wal);
+    return NULL;
+}
+
+// Materializer thread: tail every worker's log and apply the records to the files
+void *materializer(void *arg) {
+    (void)arg;
+    WalReader *readers = calloc(n_workers, sizeof(WalReader));
+    WalRecord record;
+
+    if (!readers) {
+        perror("Failed to allocate WAL readers");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < n_workers; i++) wal_reader_init(&readers[i], i, wal_first_segment);
+
+    // Segments left by the previous run come first: a player's new game must not reach the files
+    // before the end of its previous one
+    if (materializer_catch_up) {
+        long caught_up = wal_replay(materialize_leftover, NULL, wal_first_segment, NULL);
+        if (leftovers_covered) wal_discard(wal_first_segment);
+        if (verbose) vlog("Materialized %ld WAL records of the previous run\n", caught_up);
+    }
+
+    while (1) {
+        pthread_mutex_lock(&materializer_mutex);
+        while (!materializer_pending && !materializer_stop) pthread_cond_wait(&materializer_cond, &materializer_mutex);
+        int stopping = materializer_stop;
+        materializer_pending = 0;
+        pthread_mutex_unlock(&materializer_mutex);
+
+        for (int i = 0; i < n_workers; i++) {
+            while (wal_read(&readers[i], &workers[i].wal, &record)) {
+                materialize_record(&record, 0);
+                atomic_fetch_add(&workers[i].materialized, 1);
+            }
+        }
+        notify_tcp_waiting();
+        if (stopping) break;    // Everything the log writer published has been applied
+    }
+    for (int i = 0; i < n_workers; i++) wal_reader_close(&readers[i]);
+    free(readers);
+    return NULL;
+}
+
+
+// ====================== Snapshots ======================
+
+// Snapshot request, in a worker: hold still between two requests until the child has its copy
+void pause_for_snapshot(void) {
+    pthread_barrier_wait(&snapshot_barrier);    // The shard is consistent and its records are queued
+    pthread_barrier_wait(&snapshot_barrier);    // The snapshot child exists
+}
+
+// Write the games and reply caches of every worker with the given top 10 and log positions
+// (in the snapshot child, or in the main thread once the workers are gone)
+int write_snapshot(const uint64_t *positions, const ScoreEntry *scores, int n_scores) {
+    SnapshotShard shards[MAX_WORKERS];
+    for (int i = 0; i < n_workers; i++) {
+        shards[i].games = &workers[i].games;
+        shards[i].replies = &workers[i].replies;
+    }
+    return snapshot_write(shards, n_workers, positions, scores, n_scores);
+}
+
+// Records queued by every worker since the start
+uint64_t logged_records(void) {
+    uint64_t logged = 0;
+    for (int i = 0; i < n_workers; i++) logged += atomic_load(&workers[i].log_ring.head);
+    return logged;
+}
+
+// Log position of every shard, as of the last record the log writer wrote (shards this run
+// does not have start at its first segment)
+void snapshot_positions(uint64_t *positions) {
+    for (int i = 0; i < WAL_MAX_SHARDS; i++) {
+        positions[i] = i < n_workers ? atomic_load(&workers[i].wal.published) : WAL_POSITION(wal_first_segment, 0);
+    }
+}
+
+// Take a snapshot in the background: pause the workers, let the log writer empty their rings,
+// note where every log stands and fork a child that writes the paused state
+void start_snapshot(void) {
+    uint64_t positions[WAL_MAX_SHARDS], one = 1, count;
+    ScoreEntry scores[TOP_SCORES];
+    struct timespec pause = {0, 100000};
+
+    if (snapshot_child > 0) return;     // The previous one is still being written
+    if (logged_records() == snapshot_logged) return;    // Nothing happened since the last one
+    uint64_t paused_at = now_ns();
+    if (write(snapshot_fd, &one, sizeof(one)) < 0) {
+        perror("Failed to pause the workers");
+        return;
+    }
+    pthread_barrier_wait(&snapshot_barrier);
+    if (read(snapshot_fd, &count, sizeof(count)) < 0) perror("snapshot eventfd");
+
+    atomic_store(&log_writer_drain, 1);
+    while (atomic_load(&log_writer_drain)) {
+        notify_log_writer();
+        nanosleep(&pause, NULL);
+    }
+    snapshot_positions(positions);
+    snapshot_logged = logged_records();
+
+    // Segments stay until both the tables (log position) and the top 10 (applied position,
+    // read before the copy) of this snapshot no longer need them
+    for (int i = 0; i < n_workers; i++) {
+        uint32_t applied = WAL_SEGMENT_OF(atomic_load(&workers[i].wal.applied));
+        uint32_t logged = WAL_SEGMENT_OF(positions[i]);
+        snapshot_retain[i] = applied < logged ? applied : logged;
+    }
+    int n_scores = scoreboard_copy(scores);
+
+    pid_t pid = fork();
+    if (pid == 0) _exit(write_snapshot(positions, scores, n_scores) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    pthread_barrier_wait(&snapshot_barrier);
+    if (pid < 0) {
+        perror("Failed to fork the snapshot writer");
+        snapshot_logged = UINT64_MAX;
+        return;
+    }
+    snapshot_child = pid;
+    if (verbose) printf("Snapshot started (workers paused for %.2f ms)\n", (now_ns() - paused_at) / 1e6);
+}
+
+// Collect the snapshot child; once its file is in place, release the log segments it covers
+void finish_snapshot(int wait) {
+    int status;
+
+    if (snapshot_child <= 0) return;
+    pid_t done = waitpid(snapshot_child, &status, wait ? 0 : WNOHANG);
+    if (done == 0) return;
+    snapshot_child = -1;
+    if (done < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "Failed to write snapshot\n");
+        snapshot_logged = UINT64_MAX;   // Try again at the next interval
+        return;
     }
+    for (int i = 0; i < n_workers; i++) atomic_store(&workers[i].wal.retain, snapshot_retain[i]);
+    if (verbose) printf("Snapshot written\n");
+}
+
+// Milliseconds the main loop may sleep before a snapshot is due or its child should be collected
+int snapshot_timeout(time_t next_snapshot) {
+    if (snapshot_child > 0) return SNAPSHOT_POLL_MS;
+    time_t left = next_snapshot - time(NULL);
+    return left > 0 ? (int)left * 1000 : 0;
 }
 
 
 
 
 /* ---------------- SCORES ---------------- */ 
-void create_score_file(const char *plid, const char *code, int trials, const char *mode, int duration, int max_playtime) {
+void create_score_file(const char *plid, const char *code, int trials, const char *mode, int duration, int max_playtime, time_t end_time) {
     char filename[100];
     char date_str[20], time_str[20];
-    time_t current_time = time(NULL);
-    struct tm *tm_info = gmtime(&current_time); // UTC
+    char *key;
+    struct tm tm_buf;
+    struct tm *tm_info = gmtime_r(&end_time, &tm_buf); // UTC
     int score;
 
     score = (100 - (((float)(trials - 1) / 7) * 50)) * (1 - ((float)duration / max_playtime) * 0.5); // Calculate the score
@@ -177,6 +653,7 @@ void create_score_file(const char *plid, const char *code, int trials, const cha
 
     // Nome do arquivo
     sprintf(filename, "SCORES/%03d_%s_%s_%s.txt", score, plid, date_str, time_str);
+    key = filename + strlen("SCORES/");
 
     // Abrir o arquivo para escrita
     FILE *file = fopen(filename, "w");
@@ -189,24 +666,736 @@ void create_score_file(const char *plid, const char *code, int trials, const cha
     fprintf(file, "%03d %s %s %d %s\n", score, plid, code, trials, mode);
     fclose(file);
 
-    if (verbose) printf("Score file created: %s\n", filename);
+    scoreboard_add(key, score, plid, code, trials, mode);
+
+    if (verbose) vlog("Score file created: %s\n", filename);
 }
 
 
 
 // =====================================================
 
-int main(int argc, char *argv[]) {
-    int udp_socket, tcp_socket, max_fd, gsport;
-    struct sockaddr_in udp_addr, tcp_addr, client_addr;
-    fd_set read_fds;
-    char buffer[BUFFER_SIZE];
+// ====================== Event loop ======================
+
+// Put a socket in non-blocking mode (required by the edge-triggered epoll loop)
+int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Register a file descriptor in the epoll instance (edge-triggered)
+int add_to_epoll(int epoll_fd, int fd, uint32_t events) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events | EPOLLET;
+    ev.data.fd = fd;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// Allocate the recvmmsg/sendmmsg vectors of a worker
+int udp_batch_init(UdpBatch *batch, int size) {
+    batch->size = size;
+    batch->rx = calloc(size, sizeof(struct mmsghdr));
+    batch->tx = calloc(size, sizeof(struct mmsghdr));
+    batch->rx_iov = calloc(size, sizeof(struct iovec));
+    batch->tx_iov = calloc(size, sizeof(struct iovec));
+    batch->addrs = calloc(size, sizeof(struct sockaddr_in));
+    batch->requests = calloc(size, BUFFER_SIZE);
+    batch->responses = calloc(size, BUFFER_SIZE);
+    batch->controls = calloc(size, sizeof(*batch->controls));
+    if (!batch->rx || !batch->tx || !batch->rx_iov || !batch->tx_iov || !batch->addrs || !batch->requests ||
+        !batch->responses || !batch->controls)
+        return -1;
+
+    // Receive slots never change: each one points at its own request buffer and address
+    for (int i = 0; i < size; i++) {
+        batch->rx_iov[i].iov_base = batch->requests[i];
+        batch->rx_iov[i].iov_len = BUFFER_SIZE - 1;
+        batch->rx[i].msg_hdr.msg_iov = &batch->rx_iov[i];
+        batch->rx[i].msg_hdr.msg_iovlen = 1;
+        batch->rx[i].msg_hdr.msg_name = &batch->addrs[i];
+        batch->rx[i].msg_hdr.msg_control = batch->controls[i];
+    }
+    return 0;
+}
+
+void udp_batch_free(UdpBatch *batch) {
+    free(batch->rx);
+    free(batch->tx);
+    free(batch->rx_iov);
+    free(batch->tx_iov);
+    free(batch->addrs);
+    free(batch->requests);
+    free(batch->responses);
+    free(batch->controls);
+}
+
+// Send the first n replies of the batch, retrying the tail if sendmmsg stops early
+int udp_batch_flush(int udp_socket, UdpBatch *batch, int n) {
+    int sent = 0;
+    while (sent < n) {
+        int r = sendmmsg(udp_socket, batch->tx + sent, n - sent, 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            // Socket buffer full or send error: drop the rest, clients retransmit
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("sendmmsg failed");
+            break;
+        }
+        sent += r;
+    }
+    return sent;
+}
+
+// Read every datagram queued on the worker's socket, a batch per recvmmsg call,
+// and answer each batch with a single sendmmsg
+void drain_udp(Worker *worker) {
+    UdpBatch *batch = &worker->batch;
+
+    while (1) {
+        for (int i = 0; i < batch->size; i++) {
+            batch->rx[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            batch->rx[i].msg_hdr.msg_controllen = sizeof(batch->controls[i]);
+        }
+
+        int n = recvmmsg(worker->udp_socket, batch->rx, batch->size, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("recvmmsg failed");
+            return;     // Socket drained (or failed), go back to epoll_wait
+        }
+
+        uint64_t received_at = now_ns();
+        counter_add(&worker->metrics.received, n);
+
+        for (int i = 0; i < n; i++) {
+            char *buffer = batch->requests[i];
+            buffer[batch->rx[i].msg_len] = '\0'; // Null-terminate received data
+            if (verbose) vlog("Received UDP message: %s", buffer);  // Confirm reception
+
+            // The kernel reports how many datagrams it had to drop on this socket so far
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&batch->rx[i].msg_hdr);
+            if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+                uint32_t dropped;
+                memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+                counter_set(&worker->metrics.dropped, dropped);
+            }
+
+            // Reply goes back to the sender of the request in the same slot
+            batch->tx_iov[i].iov_base = batch->responses[i];
+            batch->tx_iov[i].iov_len = handle_udp_message(buffer, batch->responses[i]);
+            metrics_record(&worker->metrics, buffer, batch->responses[i], now_ns() - received_at);
+            batch->tx[i].msg_hdr.msg_iov = &batch->tx_iov[i];
+            batch->tx[i].msg_hdr.msg_iovlen = 1;
+            batch->tx[i].msg_hdr.msg_name = &batch->addrs[i];
+            batch->tx[i].msg_hdr.msg_namelen = batch->rx[i].msg_hdr.msg_namelen;
+        }
+        int sent = udp_batch_flush(worker->udp_socket, batch, n);
+        if (sent < n) counter_add(&worker->metrics.reply_failures, n - sent);
+
+        // Let the log writer pick up the batch's events
+        notify_log_writer();
+
+        // A short batch means the queue is empty; new datagrams raise a new edge
+        if (n < batch->size) return;
+    }
+}
+
+// ====================== io_uring backend ======================
+
+// CQE tags of the io_uring loop; send completions carry their slot in the upper bits
+enum { URING_RECV = 0, URING_STOP = 1, URING_SEND = 2, URING_SNAPSHOT = 3 };
+
+// Watch an eventfd with a one-shot poll
+static void uring_arm_poll(Uring *ring, int fd, uint64_t tag) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = tag;
+}
+
+// Arm the multishot receive: one SQE keeps filling provided buffers until it is cancelled or
+// the buffers run out
+static int uring_arm_recv(Uring *ring, struct msghdr *template, uint16_t group) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = 0;                                // Registered file 0: the worker's socket
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->addr = (uint64_t)(uintptr_t)template;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = group;
+    sqe->user_data = URING_RECV;
+    return 0;
+}
+
+// UDP worker loop on io_uring: a multishot receive feeds provided buffers and every reply is a
+// SENDMSG SQE, so each wakeup costs one io_uring_enter that both submits the replies and waits.
+// Returns -1 before serving anything if the kernel cannot run it, so the caller can fall back.
+int udp_worker_uring(Worker *worker) {
+    Uring ring;
+    UringBuffers buffers;
+    struct msghdr template;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    int served = 0, armed = 0, stop = 0, pausing = 0, result = 0;
+
+    if (uring_init(&ring, URING_ENTRIES, URING_ENTRIES * 4) < 0) return -1;
+
+    // Each buffer holds the recvmsg header, the sender address, the drop counter and the payload
+    memset(&template, 0, sizeof(template));
+    template.msg_namelen = sizeof(struct sockaddr_in);
+    template.msg_controllen = CMSG_SPACE(sizeof(uint32_t));
+    unsigned header = sizeof(struct io_uring_recvmsg_out) + template.msg_namelen + template.msg_controllen;
+
+    if (uring_register_files(&ring, &worker->udp_socket, 1) < 0 ||
+        uring_buffers_init(&ring, &buffers, 0, URING_RECV_BUFFERS, header + BUFFER_SIZE) < 0) {
+        uring_free(&ring);
+        return -1;
+    }
+
+    UringSend *slots = calloc(URING_SEND_SLOTS, sizeof(UringSend));
+    uint32_t *free_slots = malloc(URING_SEND_SLOTS * sizeof(uint32_t));
+    if (!slots || !free_slots) {
+        perror("Failed to allocate io_uring send slots");
+        exit(EXIT_FAILURE);
+    }
+    int n_free = 0;
+    for (int i = URING_SEND_SLOTS - 1; i >= 0; i--) free_slots[n_free++] = i;
+
+    // Shutdown and snapshot requests: one-shot polls on their eventfds
+    uring_arm_poll(&ring, shutdown_fd, URING_STOP);
+    uring_arm_poll(&ring, snapshot_fd, URING_SNAPSHOT);
+    armed = uring_arm_recv(&ring, &template, buffers.group) == 0;
+
+    if (verbose) printf("UDP worker %d running on io_uring\n", worker->id);
+
+    while (!stop) {
+        // Submit the replies of the last round and sleep until a completion or the next timer tick
+        if (uring_submit_and_wait(&ring, 1, timer_wheel_timeout(game_timers)) < 0) {
+            perror("io_uring_enter");
+            break;
+        }
+        timer_wheel_advance(game_timers, time(NULL), expire_game, NULL);
+
+        uint64_t received_at = now_ns();
+        int received = 0, failed = 0;
+
+        while ((cqe = uring_peek_cqe(&ring)) != NULL) {
+            uint64_t tag = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            uring_cqe_seen(&ring);
+
+            if (tag == URING_STOP) {
+                stop = 1;
+                continue;
+            }
+            if (tag == URING_SNAPSHOT) {
+                pausing = 1;
+                continue;
+            }
+            if ((tag & 3) == URING_SEND) {
+                free_slots[n_free++] = (uint32_t)(tag >> 2);
+                if (res < 0) failed++;
+                continue;
+            }
+
+            // Receive completion; without F_MORE the multishot request has ended and is re-armed below
+            if (!(flags & IORING_CQE_F_MORE)) armed = 0;
+            if (res < 0) {
+                if (res == -ENOBUFS) continue;      // All buffers in use until this round recycles them
+                if (!served) {
+                    result = -1;                    // No multishot recvmsg (kernel < 6.0): use epoll
+                    stop = 1;
+                    break;
+                }
+                fprintf(stderr, "io_uring recvmsg: %s\n", strerror(-res));
+                continue;
+            }
+
+            uint16_t id = flags >> IORING_CQE_BUFFER_SHIFT;
+            char *buf = uring_buffer(&buffers, id);
+            struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buf;
+            struct sockaddr_in *from = (struct sockaddr_in *)(buf + sizeof(*out));
+            char *control = (char *)from + template.msg_namelen;
+            char *buffer = control + template.msg_controllen;
+            unsigned len = out->payloadlen < BUFFER_SIZE - 1 ? out->payloadlen : BUFFER_SIZE - 1;
+            buffer[len] = '\0';   // Null-terminate received data
+            received++;
+            served = 1;
+            if (verbose) vlog("Received UDP message: %s", buffer);
+
+            // The kernel reports how many datagrams it had to drop on this socket so far
+            struct msghdr view = { .msg_control = control, .msg_controllen = out->controllen };
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&view);
+            if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+                uint32_t dropped;
+                memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+                counter_set(&worker->metrics.dropped, dropped);
+            }
+
+            // There are more slots than receive buffers, so this only fails if sends stall
+            if (n_free == 0) {
+                failed++;
+                uring_buffers_recycle(&buffers, id);
+                continue;
+            }
+            uint32_t index = free_slots[--n_free];
+            UringSend *slot = &slots[index];
+            slot->iov.iov_base = slot->response;
+            slot->iov.iov_len = handle_udp_message(buffer, slot->response);
+            metrics_record(&worker->metrics, buffer, slot->response, now_ns() - received_at);
+            slot->addr = *from;
+            memset(&slot->msg, 0, sizeof(slot->msg));
+            slot->msg.msg_name = &slot->addr;
+            slot->msg.msg_namelen = sizeof(slot->addr);
+            slot->msg.msg_iov = &slot->iov;
+            slot->msg.msg_iovlen = 1;
+            uring_buffers_recycle(&buffers, id);
+
+            // Reply goes back to the sender; it is submitted with the next io_uring_enter
+            if ((sqe = uring_get_sqe(&ring)) == NULL) {
+                free_slots[n_free++] = index;
+                failed++;
+                continue;
+            }
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = 0;
+            sqe->flags = IOSQE_FIXED_FILE;
+            sqe->addr = (uint64_t)(uintptr_t)&slot->msg;
+            sqe->len = 1;
+            sqe->user_data = (uint64_t)index << 2 | URING_SEND;
+        }
+
+        // Hand this round's buffers back and keep the receive armed
+        uring_buffers_publish(&buffers);
+        if (!armed && !stop) armed = uring_arm_recv(&ring, &template, buffers.group) == 0;
+
+        counter_add(&worker->metrics.received, received);
+        if (failed) counter_add(&worker->metrics.reply_failures, failed);
+
+        // Let the log writer pick up this round's events (expired games included)
+        notify_log_writer();
+
+        // Snapshot: wait at the barrier, then watch for the next request
+        if (pausing) {
+            pause_for_snapshot();
+            pausing = 0;
+            uring_arm_poll(&ring, snapshot_fd, URING_SNAPSHOT);
+        }
+    }
+
+    // Closing the ring cancels the outstanding requests
+    uring_free(&ring);
+    uring_buffers_free(&buffers);
+    free(slots);
+    free(free_slots);
+    return result;
+}
+
+// Accept every pending TCP connection and register it in the epoll instance
+void drain_accept(int tcp_socket, int epoll_fd) {
+    struct sockaddr_in client_addr;
     socklen_t addr_len;
+
+    while (1) {
+        addr_len = sizeof(client_addr);
+        int client_socket = accept4(tcp_socket, (struct sockaddr*)&client_addr, &addr_len, SOCK_NONBLOCK);
+        if (client_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("TCP accept");
+            return;     // No more pending connections
+        }
+        if (verbose) vlog("New TCP client connected\n");
+
+        // conn_new registers nothing when it fails (the table may not even cover this fd yet)
+        Connection *conn = conn_new(client_socket);
+        if (!conn) {
+            perror("Failed to allocate connection");
+            close(client_socket);
+            continue;
+        }
+        if (timer_wheel_add(&idle_timers, client_socket, time(NULL) + TCP_IDLE_TIMEOUT) < 0) {
+            perror("Failed to allocate connection timer");
+            conn_close(conn);
+            continue;
+        }
+
+        // Watch both directions once: the state machine decides what to do on each edge
+        if (add_to_epoll(epoll_fd, client_socket, EPOLLIN | EPOLLOUT | EPOLLRDHUP) < 0) {
+            perror("epoll_ctl client");
+            conn_close(conn);
+        }
+    }
+}
+
+// ====================== TCP connections ======================
+
+// Create the connection object for an accepted socket (indexed by its fd)
+Connection *conn_new(int fd) {
+    if (fd >= connections_cap) {
+        int new_cap = connections_cap ? connections_cap : 64;
+        while (new_cap <= fd) new_cap *= 2;
+        Connection **grown = realloc(connections, new_cap * sizeof(Connection *));
+        if (!grown) return NULL;
+        memset(grown + connections_cap, 0, (new_cap - connections_cap) * sizeof(Connection *));
+        connections = grown;
+        connections_cap = new_cap;
+    }
+
+    Connection *conn = calloc(1, sizeof(Connection));
+    if (!conn) return NULL;
+    conn->fd = fd;
+    conn->state = CONN_READING;
+    conn->file_fd = -1;
+    connections[fd] = conn;
+    return conn;
+}
+
+// Close the socket (which also removes it from epoll) and release the connection
+void conn_close(Connection *conn) {
+    conn_unwait(conn);
+    connections[conn->fd] = NULL;
+    timer_wheel_remove(&idle_timers, conn->fd);
+    if (conn->file_fd >= 0) close(conn->file_fd);
+    close(conn->fd);
+    free(conn);
+}
+
+// Read whatever is available; returns 1 once a full request line is buffered
+int conn_read(Connection *conn) {
+    // A pipelined request may already be waiting behind the previous one
+    if (conn->in_len > 0 && memchr(conn->in_buf, '\n', conn->in_len)) return 1;
+
+    while (conn->in_len < BUFFER_SIZE - 1) {
+        ssize_t n = read(conn->fd, conn->in_buf + conn->in_len, BUFFER_SIZE - 1 - conn->in_len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;  // Wait for the next edge
+            conn->state = CONN_CLOSED;
+            return 0;
+        }
+        if (n == 0) {
+            // Peer closed its side: parse what we have, or drop an empty connection
+            if (conn->in_len == 0) conn->state = CONN_CLOSED;
+            return conn->in_len > 0;
+        }
+        conn->in_len += n;
+        conn->in_buf[conn->in_len] = '\0';
+        if (memchr(conn->in_buf, '\n', conn->in_len)) return 1;
+    }
+    return 1;   // Buffer full: parse it as is
+}
+
+// Write the pending reply; returns 1 once it has been fully sent
+int conn_write(Connection *conn) {
+    while (conn->out_off < conn->out_len) {
+        ssize_t n = send(conn->fd, conn->out_buf + conn->out_off, conn->out_len - conn->out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;  // Socket buffer full, wait for EPOLLOUT
+            conn->state = CONN_CLOSED;
+            return 0;
+        }
+        conn->out_off += n;
+    }
+
+    // Then the file body, straight from the page cache
+    while (conn->file_fd >= 0 && conn->file_off < conn->file_len) {
+        ssize_t n = sendfile(conn->fd, conn->file_fd, &conn->file_off, conn->file_len - conn->file_off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;  // Socket buffer full, wait for EPOLLOUT
+            conn->state = CONN_CLOSED;
+            return 0;
+        }
+        if (n == 0) break;  // File shorter than announced: nothing more to send
+    }
+    return 1;
+}
+
+// Drop the request just answered and get ready for the next one on a keep-alive connection
+void conn_next_request(Connection *conn) {
+    char *end = memchr(conn->in_buf, '\n', conn->in_len);
+    int used = end ? end - conn->in_buf + 1 : conn->in_len;
+    while (used < conn->in_len && conn->in_buf[used] == '\0') used++;   // Terminator sent by older clients
+
+    conn->in_len -= used;
+    memmove(conn->in_buf, conn->in_buf + used, conn->in_len);
+    conn->in_buf[conn->in_len] = '\0';
+
+    if (conn->file_fd >= 0) close(conn->file_fd);
+    conn->file_fd = -1;
+    conn->file_off = conn->file_len = 0;
+    conn->out_len = conn->out_off = 0;
+    conn->state = CONN_READING;
+}
+
+// Whether the materializer has applied the records a waiting STR needs
+int conn_caught_up(const Connection *conn) {
+    return atomic_load(&workers[conn->wait_shard].materialized) >= conn->wait_for;
+}
+
+// Hold an STR until the materializer catches up (resume_waiting serves it then)
+void conn_wait(Connection *conn) {
+    uint64_t one = 1;
+
+    conn->next_waiting = waiting_connections;
+    waiting_connections = conn;
+    atomic_fetch_add(&tcp_waiting, 1);
+
+    // Records applied before the count was raised did not wake the loop
+    if (conn_caught_up(conn) && write(materialized_fd, &one, sizeof(one)) < 0) perror("Failed to wake the TCP loop");
+}
+
+// Take a connection off the waiting list, if it is on it
+void conn_unwait(Connection *conn) {
+    for (Connection **link = &waiting_connections; *link; link = &(*link)->next_waiting) {
+        if (*link == conn) {
+            *link = conn->next_waiting;
+            atomic_fetch_sub(&tcp_waiting, 1);
+            return;
+        }
+    }
+}
+
+// The materializer applied more records: serve the waiting STRs whose records are all in the files
+void resume_waiting(void) {
+    uint64_t count;
+    if (read(materialized_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) perror("materializer eventfd");
+
+    Connection **link = &waiting_connections;
+    while (*link) {
+        Connection *conn = *link;
+        if (!conn_caught_up(conn)) {
+            link = &conn->next_waiting;
+            continue;
+        }
+        *link = conn->next_waiting;
+        atomic_fetch_sub(&tcp_waiting, 1);
+        handle_tcp_request(conn);       // Builds the reply now
+        conn->state = CONN_WRITING;
+        handle_tcp_event(conn->fd, 0);  // Send it, and go on with the requests behind it
+    }
+}
+
+// Idle timer of a connection fired: nothing was received or sent for TCP_IDLE_TIMEOUT seconds
+void expire_connection(uint32_t fd, void *ctx) {
+    (void)ctx;
+    Connection *conn = (int)fd < connections_cap ? connections[fd] : NULL;
+    if (!conn) return;
+    if (verbose) vlog("Closing idle TCP connection %u\n", fd);
+    conn_close(conn);
+}
+
+// Advance the connection state machine after an epoll notification
+void handle_tcp_event(int fd, uint32_t events) {
+    Connection *conn = fd < connections_cap ? connections[fd] : NULL;
+    if (!conn) return;
+
+    if (events & EPOLLERR) conn->state = CONN_CLOSED;
+
+    // Serve the buffered requests in order, one reply at a time, until the socket would block
+    // (or an STR has to wait for the materializer, which resumes it)
+    while (conn->state != CONN_CLOSED && conn->state != CONN_WAITING) {
+        if (conn->state == CONN_READING) {
+            if (!conn_read(conn)) break;
+            if (verbose) vlog("Received TCP message: %.*s\n", (int)strcspn(conn->in_buf, "\n"), conn->in_buf);
+            conn->started = now_ns();
+            handle_tcp_request(conn);   // Parse and build the whole reply
+            if (conn->state == CONN_WAITING) {
+                conn_wait(conn);
+                break;
+            }
+            conn->state = CONN_WRITING;
+        }
+
+        if (!conn_write(conn)) break;
+
+        // Latency covers the whole reply, file body included
+        if (strncmp(conn->in_buf, "MET", 3) != 0 && strncmp(conn->in_buf, "KAL", 3) != 0)
+            metrics_record(&tcp_metrics, conn->in_buf, conn->out_buf, now_ns() - conn->started);
+
+        if (conn->keep_alive) conn_next_request(conn);
+        else conn->state = CONN_CLOSED;     // One request per connection
+    }
+
+    if (conn->state == CONN_CLOSED) {
+        conn_close(conn);
+        return;
+    }
+
+    // Any traffic pushes the idle deadline back
+    timer_wheel_add(&idle_timers, fd, time(NULL) + TCP_IDLE_TIMEOUT);
+}
+
+// ====================== UDP workers ======================
+
+// Create a UDP socket bound to the game port, shared by all workers through SO_REUSEPORT
+int create_udp_socket(int port) {
+    struct sockaddr_in udp_addr;
+    int one = 1;
+    int udp_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp_socket < 0) {
+        perror("UDP socket");
+        return -1;
+    }
+
+    if (setsockopt(udp_socket, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        perror("SO_REUSEPORT");
+        close(udp_socket);
+        return -1;
+    }
+
+    // Have recvmmsg report the socket's drop counter (for the metrics)
+    if (setsockopt(udp_socket, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) < 0) perror("SO_RXQ_OVFL");
+
+    // Configure the UDP socket address
+    memset(&udp_addr, 0, sizeof(udp_addr));
+    udp_addr.sin_family = AF_INET;          // IPv4
+    udp_addr.sin_addr.s_addr = INADDR_ANY;  // Accept connections from any address
+    udp_addr.sin_port = htons(port);        // Set the UDP port
+
+    // Bind the UDP socket to the specified address
+    if (bind(udp_socket, (struct sockaddr*)&udp_addr, sizeof(udp_addr)) < 0) {
+        perror("UDP bind");
+        close(udp_socket);
+        return -1;
+    }
+
+    // The socket is drained until EAGAIN, so it must not block
+    if (set_nonblocking(udp_socket) < 0) {
+        perror("fcntl");
+        close(udp_socket);
+        return -1;
+    }
+    return udp_socket;
+}
+
+/*
+ * Steer every datagram to the worker that owns its PLID.
+ * All requests carry the PLID at bytes 4..9 ("SNG 123456 ..."), so a classic BPF program
+ * attached to the reuseport group decodes those six digits and returns PLID % n_workers,
+ * the index of the socket (in bind order) that must receive it. Datagrams too short to
+ * hold a PLID make the program return 0 and land on the first worker.
+ */
+int attach_plid_steering(int udp_socket, int n_workers) {
+    struct sock_filter code[3 + 5 * 7 + 3];
+    int n = 0;
+
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 4);     // A = payload[4]
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, '0');  // A -= '0'
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_ST, 0);                       // M[0] = A
+    for (int k = 5; k <= 9; k++) {
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B | BPF_ABS, k); // A = payload[k]
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, '0');
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_MISC | BPF_TAX, 0);       // X = digit
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_MEM, 0);         // A = M[0]
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 10);
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0); // A = A * 10 + digit
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_ST, 0);                   // M[0] = A
+    }
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_MEM, 0);
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, n_workers);
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);               // Socket index
+
+    struct sock_fprog prog = { .len = n, .filter = code };
+    return setsockopt(udp_socket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+}
+
+// UDP worker thread: owns one socket and one shard of the game state
+void *udp_worker(void *arg) {
+    Worker *worker = arg;
+    struct epoll_event events[MAX_EVENTS];
+    int epoll_fd;
+
+    // Bind this thread to its shard
+    active_games = &worker->games;
+    game_timers = &worker->timers;
+    game_log = &worker->log_ring;
+    reply_cache = &worker->replies;
+    shard_metrics = &worker->metrics;
+    if (udp_batch_init(&worker->batch, udp_batch_size) < 0) {
+        perror("Failed to allocate UDP batch");
+        exit(EXIT_FAILURE);
+    }
+    key_seed = (unsigned int)time(NULL) ^ (unsigned int)(worker->id * 2654435761u);
+
+    // Pin the worker to its own core
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus > 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(worker->id % n_cpus, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0 && verbose)
+            printf("Worker %d: could not set CPU affinity\n", worker->id);
+    }
+
+    // io_uring backend if requested and supported; the epoll loop below is the fallback
+    if (use_uring) {
+        if (udp_worker_uring(worker) == 0) return NULL;
+        if (verbose) printf("Worker %d: io_uring unavailable, using epoll\n", worker->id);
+    }
+
+    // The shutdown and snapshot eventfds are only read by the main thread, so they wake every worker
+    if ((epoll_fd = epoll_create1(0)) < 0 || add_to_epoll(epoll_fd, worker->udp_socket, EPOLLIN) < 0 ||
+        add_to_epoll(epoll_fd, shutdown_fd, EPOLLIN) < 0 || add_to_epoll(epoll_fd, snapshot_fd, EPOLLIN) < 0) {
+        perror("worker epoll");
+        exit(EXIT_FAILURE);
+    }
+
+    if (verbose) printf("UDP worker %d running\n", worker->id);
+
+    while (!stop_requested) {
+        // Sleep until traffic arrives or the next timer tick is due
+        int timeout = timer_wheel_timeout(game_timers);
+
+        int n_events = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        if (n_events < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        // Finalize the games that expired since the last tick (also keeps the wheel in step with the clock)
+        timer_wheel_advance(game_timers, time(NULL), expire_game, NULL);
+
+        // Handle every datagram queued since the last wakeup
+        int pausing = 0;
+        for (int i = 0; i < n_events; i++) {
+            if (events[i].data.fd == worker->udp_socket) drain_udp(worker);
+            else if (events[i].data.fd == snapshot_fd) pausing = 1;
+        }
+
+        // Expired games queued records too
+        notify_log_writer();
+        if (pausing) pause_for_snapshot();
+    }
+
+    close(epoll_fd);
+    return NULL;
+}
+
+// SIGINT/SIGTERM: leave the main loop, which then shuts the threads down in order
+void request_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+// =====================================================
+
+int main(int argc, char *argv[]) {
+    int tcp_socket, epoll_fd, gsport;
+    struct sockaddr_in tcp_addr;
+    struct epoll_event events[MAX_EVENTS];
     
     gsport = PORT;
     
     int opt;
-    while ((opt = getopt(argc, argv, "p:v"))!= -1) {
+    while ((opt = getopt(argc, argv, "p:vw:b:f:us:"))!= -1) {
         switch (opt) {
             case 'p':
                 gsport = atoi(optarg);
@@ -214,34 +1403,82 @@ int main(int argc, char *argv[]) {
             case 'v':
                 verbose = 1;
                 break;
+            case 'w':
+                n_workers = atoi(optarg);
+                if (n_workers < 1 || n_workers > MAX_WORKERS) {
+                    printf("Invalid worker count (1-%d)\n", MAX_WORKERS);
+                    exit(1);
+                }
+                break;
+            case 'b':
+                udp_batch_size = atoi(optarg);
+                if (udp_batch_size < 1 || udp_batch_size > MAX_UDP_BATCH) {
+                    printf("Invalid UDP batch size (1-%d)\n", MAX_UDP_BATCH);
+                    exit(1);
+                }
+                break;
+            case 'f':
+                wal_fsync_interval = atoi(optarg);
+                if (wal_fsync_interval < 0) {
+                    printf("Invalid fsync interval\n");
+                    exit(1);
+                }
+                break;
+            case 'u':
+                use_uring = 1;
+                break;
+            case 's':
+                snapshot_interval = atoi(optarg);
+                if (snapshot_interval < 1) {
+                    printf("Invalid snapshot interval\n");
+                    exit(1);
+                }
+                break;
             default:
-                printf("Usage: GS [-p port] [-v]\n");
+                printf("Usage: GS [-p port] [-v] [-w workers] [-b batch] [-f fsync_ms] [-u] [-s snapshot_s]\n");
                 exit(1);
         }
     }
 
+    // Request-path messages of -v are formatted and written by a background thread
+    if (verbose && vlog_start(stdout) < 0) {
+        perror("Failed to start the log thread");
+        exit(EXIT_FAILURE);
+    }
+
+    // A client that hangs up during sendfile() must not kill the server (send() uses MSG_NOSIGNAL)
+    signal(SIGPIPE, SIG_IGN);
+
     // Create GAMES and SCORES directories
     create_directories();
 
-    // Initialize the game state
-    initialize_games();
+    // Precompute the (nB, nW) of every secret/guess pair before the workers start
+    feedback_init();
 
-    // Create UDP socket
-    if ((udp_socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-        perror("UDP socket");
+    // Map the per-player index of finished games (rebuilt from GAMES/ if missing)
+    int rebuilt = player_index_open();
+    if (rebuilt < 0) fprintf(stderr, "Player index unavailable, STR will scan GAMES/\n");
+    else if (verbose && rebuilt) printf("Player index rebuilt from GAMES/\n");
+
+    // Create one UDP socket per worker, all bound to the game port
+    workers = calloc(n_workers, sizeof(Worker));
+    if (!workers) {
+        perror("Failed to allocate workers");
         exit(EXIT_FAILURE);
     }
+    for (int i = 0; i < n_workers; i++) {
+        workers[i].id = i;
+        if ((workers[i].udp_socket = create_udp_socket(gsport)) < 0) exit(EXIT_FAILURE);
+        if (log_ring_init(&workers[i].log_ring, LOG_RING_SIZE) < 0) {
+            perror("Failed to allocate log ring");
+            exit(EXIT_FAILURE);
+        }
+        initialize_games(&workers[i]);
+    }
 
-    // Configure the UDP socket address
-    memset(&udp_addr, 0, sizeof(udp_addr));
-    udp_addr.sin_family = AF_INET;          // IPv4
-    udp_addr.sin_addr.s_addr = INADDR_ANY;  // Accept connections from any address
-    udp_addr.sin_port = htons(gsport);    // Set the UDP port
-
-    // Bind the UDP socket to the specified address
-    if (bind(udp_socket, (struct sockaddr*)&udp_addr, sizeof(udp_addr)) < 0) {
-        perror("UDP bind");
-        close(udp_socket);
+    // Keep each PLID on the same worker so game state needs no locking
+    if (n_workers > 1 && attach_plid_steering(workers[0].udp_socket, n_workers) < 0) {
+        perror("SO_ATTACH_REUSEPORT_CBPF");
         exit(EXIT_FAILURE);
     }
 
@@ -260,589 +1497,755 @@ int main(int argc, char *argv[]) {
     // Bind the TCP socket to the specified address
     if (bind(tcp_socket, (struct sockaddr*)&tcp_addr, sizeof(tcp_addr)) < 0) {
         perror("TCP bind");
-        close(udp_socket);
         close(tcp_socket);
         exit(EXIT_FAILURE);
     }
 
     // Start listening for incoming TCP connections
-    if (listen(tcp_socket, MAX_CLIENTS) < 0) {
+    if (listen(tcp_socket, TCP_BACKLOG) < 0) {
         perror("TCP listen");
-        close(udp_socket);
         close(tcp_socket);
         exit(EXIT_FAILURE);
     }
 
-    if (verbose) printf("Server running on port %d\n", gsport);
+    // The listener is drained until EAGAIN, so it must not block
+    if (set_nonblocking(tcp_socket) < 0) {
+        perror("fcntl");
+        close(tcp_socket);
+        exit(EXIT_FAILURE);
+    }
 
-    // Main server loop: Use select to handle multiple sockets
-    while (1) {
-        // Clear the file descriptor set and add the sockets
-        FD_ZERO(&read_fds);
-        FD_SET(udp_socket, &read_fds);
-        FD_SET(tcp_socket, &read_fds);
+    // Load the state of the latest snapshot and bring its games up to date with the records
+    // logged after it; the previous run's segments reach GAMES/ and SCORES/ in the background
+    struct timespec recovery_start, recovery_end;
+    clock_gettime(CLOCK_MONOTONIC, &recovery_start);
+    Snapshot snapshot;
+    uint32_t next_segment;
+    if (snapshot_open(&snapshot) == 0) {
+        restore_snapshot(&snapshot);
+        snapshot_close(&snapshot);
+        long replayed = wal_replay(restore_record, replay_from, UINT32_MAX, &next_segment);
+        if (verbose && replayed) printf("Restored %ld WAL records logged after the snapshot\n", replayed);
+        materializer_catch_up = next_segment > 0;
+    } else {
+        // Rank the existing score files once (new scores are added as they are written)
+        int ranked = scoreboard_load();
+        if (verbose) printf("Scoreboard loaded with %d entries\n", ranked);
+
+        // Materialize whatever a previous run logged but did not write to GAMES/ and SCORES/,
+        // then rebuild the games that were in progress from their files
+        long replayed = wal_replay(materialize_leftover, NULL, UINT32_MAX, &next_segment);
+        if (verbose && replayed) printf("Replayed %ld WAL records\n", replayed);
+        recover_games(restore_game, NULL, 0);
+    }
+    if (next_segment > wal_first_segment) wal_first_segment = next_segment;
+    clock_gettime(CLOCK_MONOTONIC, &recovery_end);
+    long recovered = 0;
+    for (int i = 0; i < n_workers; i++) recovered += workers[i].games.count;
+    if (verbose && recovered) {
+        printf("Recovered %ld active games from %s in %.1f ms\n", recovered, snapshot_loaded ? "the snapshot" : "GAMES/",
+               (recovery_end.tv_sec - recovery_start.tv_sec) * 1e3 + (recovery_end.tv_nsec - recovery_start.tv_nsec) / 1e6);
+    }
+
+    // This run logs from a new segment, after a snapshot of the recovered state: the previous
+    // segments are then only needed until they are materialized. Both ports are bound by now, so
+    // a server that cannot get them exits above, before replacing the snapshot or the WAL
+    uint64_t positions[WAL_MAX_SHARDS];
+    ScoreEntry scores[TOP_SCORES];
+    for (int i = 0; i < WAL_MAX_SHARDS; i++) positions[i] = WAL_POSITION(wal_first_segment, 0);
+    if (snapshot_loaded && next_segment == 0) leftovers_covered = 1;
+    else if (write_snapshot(positions, scores, scoreboard_copy(scores)) == 0) leftovers_covered = 1;
+    else perror("Failed to write snapshot");
+    if (leftovers_covered && !materializer_catch_up) wal_discard(wal_first_segment);
+    for (int i = 0; i < n_workers; i++) {
+        if (wal_open(&workers[i].wal, i, wal_first_segment) < 0) exit(EXIT_FAILURE);
+    }
+
+    timer_wheel_init(&idle_timers, time(NULL));
+
+    // Create the epoll instance for the TCP side and register the listening socket
+    if ((epoll_fd = epoll_create1(0)) < 0) {
+        perror("epoll_create1");
+        close(tcp_socket);
+        exit(EXIT_FAILURE);
+    }
+    if (add_to_epoll(epoll_fd, tcp_socket, EPOLLIN) < 0) {
+        perror("epoll_ctl");
+        close(epoll_fd);
+        close(tcp_socket);
+        exit(EXIT_FAILURE);
+    }
 
-        // Determine the highest file descriptor value
-        max_fd = udp_socket > tcp_socket ? udp_socket : tcp_socket;
+    // SIGINT/SIGTERM stop the server cleanly; only this thread takes them
+    if ((log_writer_fd = eventfd(0, 0)) < 0 || (shutdown_fd = eventfd(0, 0)) < 0 || (snapshot_fd = eventfd(0, 0)) < 0 ||
+        (materialized_fd = eventfd(0, EFD_NONBLOCK)) < 0 || add_to_epoll(epoll_fd, materialized_fd, EPOLLIN) < 0) {
+        perror("eventfd");
+        exit(EXIT_FAILURE);
+    }
+    pthread_barrier_init(&snapshot_barrier, NULL, n_workers + 1);
+    sigset_t stop_signals, old_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+
+    // Start the materializer and the log writer, then the UDP workers
+    if (pthread_create(&materializer_thread, NULL, materializer, NULL) != 0 ||
+        pthread_create(&log_writer_thread, NULL, log_writer, NULL) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < n_workers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, udp_worker, &workers[i]) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
 
-        // Use select to wait for activity on the sockets
-        if (select(max_fd + 1, &read_fds, NULL, NULL, NULL) < 0) {
-            perror("select");
+    if (verbose) printf("Server running on port %d with %d UDP worker(s)\n", gsport, n_workers);
+
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = request_stop;
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    // Main server loop (TCP): wait for readiness and drain every ready socket
+    time_t next_snapshot = time(NULL) + snapshot_interval;
+    while (!stop_requested) {
+        // Sleep until traffic arrives, an idle connection is due to be closed or a snapshot is due
+        int timeout = timer_wheel_timeout(&idle_timers);
+        int snapshot_due = snapshot_timeout(next_snapshot);
+        if (timeout < 0 || snapshot_due < timeout) timeout = snapshot_due;
+
+        int n_events = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        if (n_events < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
             break;
         }
+        timer_wheel_advance(&idle_timers, time(NULL), expire_connection, NULL);
 
-        // If the UDP socket is ready, handle an incoming message
-        if (FD_ISSET(udp_socket, &read_fds)) {
-            addr_len = sizeof(client_addr);
-            memset(buffer, 0, BUFFER_SIZE);
-            //recvfrom(udp_socket, buffer, BUFFER_SIZE, 0, (struct sockaddr*)&client_addr, &addr_len);
-            //printf("Received UDP message: %s\n", buffer);
-            //handle_udp_message(udp_socket, &client_addr, addr_len, buffer);
+        finish_snapshot(0);
+        if (time(NULL) >= next_snapshot) {
+            start_snapshot();
+            next_snapshot = time(NULL) + snapshot_interval;
+        }
 
-            if (verbose) printf("Waiting for UDP message...\n"); 
+        for (int i = 0; i < n_events; i++) {
+            int fd = events[i].data.fd;
 
-            ssize_t n = recvfrom(udp_socket, buffer, BUFFER_SIZE, 0, 
-                                (struct sockaddr*)&client_addr, &addr_len);
-            if (n < 0) {
-                perror("recvfrom failed");
-            } else {
-                buffer[n] = '\0'; // Null-terminate received data
-                if (verbose) printf("Received UDP message: %s", buffer);  // Confirm reception
-            }
+            if (fd == tcp_socket) {
+                // Accept every pending connection
+                drain_accept(tcp_socket, epoll_fd);
 
-            handle_udp_message(udp_socket, &client_addr, addr_len, buffer);
-        }
+            } else if (fd == materialized_fd) {
+                // The materializer applied records some STRs were waiting for
+                resume_waiting();
 
-        // If the TCP socket is ready, handle a new client connection
-        if (FD_ISSET(tcp_socket, &read_fds)) {
-            int client_socket = accept(tcp_socket, (struct sockaddr*)&client_addr, &addr_len);
-            if (client_socket < 0) {
-                perror("TCP accept");
-                continue;   // Continue handling other connections
+            } else {
+                // An accepted TCP client is readable or writable
+                handle_tcp_event(fd, events[i].events);
             }
-            if (verbose) printf("New TCP client connected\n");
-            handle_tcp_connection(client_socket);
-            close(client_socket);   // Close the client socket after handling the request
         }
     }
     
-    // Close both sockets before exiting
-    close(udp_socket);
+    // Stop the workers, then let the log writer drain their rings and sync every log
+    if (verbose) printf("Shutting down\n");
+    uint64_t one = 1;
+    if (write(shutdown_fd, &one, sizeof(one)) < 0) perror("Failed to stop the workers");
+    for (int i = 0; i < n_workers; i++) pthread_join(workers[i].thread, NULL);
+    atomic_store(&log_writer_stop, 1);
+    atomic_store(&log_writer_idle, 1);
+    notify_log_writer();
+    pthread_join(log_writer_thread, NULL);
+
+    // Bring GAMES/ and SCORES/ up to date with the logs
+    pthread_mutex_lock(&materializer_mutex);
+    materializer_stop = 1;
+    pthread_cond_signal(&materializer_cond);
+    pthread_mutex_unlock(&materializer_mutex);
+    pthread_join(materializer_thread, NULL);
+
+    // Last snapshot, of the final state: the next start loads it and has no log to replay
+    finish_snapshot(1);
+    snapshot_positions(positions);
+    if (write_snapshot(positions, scores, scoreboard_copy(scores)) == 0) {
+        uint32_t end = wal_first_segment;
+        for (int i = 0; i < n_workers; i++) {
+            if (WAL_SEGMENT_OF(positions[i]) >= end) end = WAL_SEGMENT_OF(positions[i]) + 1;
+        }
+        wal_discard(end);
+    } else {
+        perror("Failed to write snapshot");
+    }
+    vlog_stop();
+
+    // Close all sockets before exiting
+    close(epoll_fd);
     close(tcp_socket);
+    for (int i = 0; i < n_workers; i++) {
+        close(workers[i].udp_socket);
+        log_ring_free(&workers[i].log_ring);
+        udp_batch_free(&workers[i].batch);
+        game_table_free(&workers[i].games);
+        timer_wheel_free(&workers[i].timers);
+        reply_cache_free(&workers[i].replies);
+    }
+    pthread_barrier_destroy(&snapshot_barrier);
+    free(workers);
     return 0;
 }
 
-// Initialize the active games array
-void initialize_games() {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        active_games[i].active = 0; // Mark all games as inactive
+// Initialize the calling worker's (empty) active games table, its expiry timers and reply cache
+void initialize_games(Worker *worker) {
+    if (game_table_init(&worker->games, GAME_TABLE_INITIAL) < 0 || reply_cache_init(&worker->replies) < 0) {
+        perror("Failed to allocate game table");
+        exit(EXIT_FAILURE);
+    }
+    timer_wheel_init(&worker->timers, time(NULL));
+}
+
+// Put a game recovered from GAMES/ back in the shard its PLID is steered to
+void restore_game(const RecoveredGame *recovered, void *ctx) {
+    (void)ctx;
+    int key = recovered->game.plid;
+    Worker *worker = &workers[key % n_workers];
+
+    Game *game = game_table_insert(&worker->games, key);
+    if (!game) {
+        perror("Failed to restore game");
+        return;
+    }
+    *game = recovered->game;
+    *game_history(&worker->games, game) = recovered->history;
+    // A game that expired while the server was down is overdue: it times out on the first tick
+    if (timer_wheel_add(&worker->timers, game_slot(&worker->games, game), game_deadline(game) + 1) < 0) {
+        perror("Failed to restore game timer");
+        game_table_remove(&worker->games, key);
+    }
+}
+
+// Put the state of a snapshot back: games in the shards their PLIDs are steered to (whatever the
+// number of workers that took it), cached replies and the top 10. The log records written after
+// it are restored by restore_record.
+void restore_snapshot(const Snapshot *snapshot) {
+    const SnapshotHeader *header = snapshot->header;
+    uint32_t per_worker[MAX_WORKERS] = {0};
+
+    for (uint64_t i = 0; i < header->n_games; i++) per_worker[snapshot->games[i].game.plid % n_workers]++;
+    for (int i = 0; i < n_workers; i++) {
+        if (game_table_reserve(&workers[i].games, per_worker[i]) < 0) perror("Failed to allocate game table");
+    }
+    for (uint64_t i = 0; i < header->n_games; i++) restore_game(&snapshot->games[i], NULL);
+    for (uint32_t i = 0; i < header->n_replies; i++) {
+        const ReplyEntry *entry = &snapshot->replies[i];
+        reply_cache_store(&workers[entry->key % n_workers].replies, entry->key, entry->digest, entry->reply, entry->len);
+    }
+    for (uint32_t i = 0; i < header->n_scores; i++) {
+        const ScoreEntry *score = &snapshot->scores[i];
+        scoreboard_add(score->key, score->score, score->plid, score->code, score->trials, score->mode);
+    }
+
+    // This run logs after every position of the snapshot
+    snapshot_loaded = 1;
+    for (int i = 0; i < WAL_MAX_SHARDS; i++) {
+        replay_from[i] = header->positions[i];
+        if (WAL_SEGMENT_OF(header->positions[i]) >= wal_first_segment) wal_first_segment = WAL_SEGMENT_OF(header->positions[i]) + 1;
+    }
+}
+
+// WAL replay at startup, with a snapshot: apply a record logged after it to the games, as the
+// worker did when it logged it
+void restore_record(const WalRecord *record, int shard, uint64_t position) {
+    (void)shard;
+    (void)position;
+    int key = plid_key(record->plid);
+    if (key < 0) return;
+    Worker *worker = &workers[key % n_workers];
+    Game *game = game_table_find(&worker->games, key);
+
+    // The player's cached reply predates this event
+    reply_cache_forget(&worker->replies, key);
+
+    // An end, or a start replacing a game whose end was not logged, releases the game
+    if (game && record->type != WAL_TRIAL) {
+        timer_wheel_remove(&worker->timers, game_slot(&worker->games, game));
+        game_table_remove(&worker->games, key);
+        game = NULL;
+    }
+
+    if (record->type == WAL_START) {
+        RecoveredGame recovered;
+        int shape = shape_of_pegs(strlen(record->code));
+        int secret = shape < 0 ? -1 : code_index(shape, record->code);
+        if (secret < 0) return;
+
+        memset(&recovered, 0, sizeof(recovered));
+        recovered.game.plid = key;
+        recovered.game.shape = shape;
+        recovered.game.secret = secret;
+        recovered.game.debug = record->mode == 'D';
+        recovered.game.start = game_time(record->time);
+        recovered.game.deadline = recovered.game.start + record->max_playtime;
+        recovered.game.active = 1;
+        restore_game(&recovered, NULL);
+    } else if (record->type == WAL_TRIAL && game && record->trials >= 1 && record->trials <= GAME_MAX_TRIALS) {
+        int guess = code_index(game->shape, record->code);
+        if (guess < 0) return;
+        game_history(&worker->games, game)->guesses[record->trials - 1] = guess;
+        if (record->trials > game->trials) game->trials = record->trials;
     }
 }
 
-// Generate a random secret key for the game
-void generate_secret_key(char *secret_key) {
-    const char colors[] = "RGBYOP";
-    for (int i = 0; i < 4; i++) {
-        secret_key[i] = colors[rand() % 6];
+// WAL replay of the previous run's records, which may not have reached the files yet
+void materialize_leftover(const WalRecord *record, int shard, uint64_t position) {
+    (void)shard;
+    (void)position;
+    materialize_record(record, 1);
+}
+
+// Timer wheel callback: finalize a game whose playtime ran out without a TRY noticing it
+void expire_game(uint32_t slot, void *ctx) {
+    (void)ctx;
+    Game *game = &active_games->games[slot];
+    char plid[7];
+
+    if (!game->active) return;
+    plid_string(game->plid, plid);  // finish_game releases the record
+    if (verbose) vlog("Game of player %s timed out\n", plid);
+
+    game->active = 0;
+    finish_game(plid, "T");     // Finalize the game with "T" (Timeout)
+    reply_cache_forget(reply_cache, plid_key(plid));    // A repeated SNG must now start a new game
+}
+
+// Generate a random secret key for a game of the given shape
+void generate_secret_key(char *secret_key, int shape) {
+    for (int i = 0; i < game_shapes[shape].pegs; i++) {
+        secret_key[i] = colors[rand_r(&key_seed) % game_shapes[shape].colors];
     }
-    secret_key[4] = '\0';   // Null-terminate the string
+    secret_key[game_shapes[shape].pegs] = '\0';   // Null-terminate the string
     // for easy acess in some functions
-    snprintf(formatted_key, 10, "%c %c %c %c", secret_key[0], secret_key[1], secret_key[2], secret_key[3]);
-    formatted_key[7] = '\0'; 
+    format_secret_key(secret_key, formatted_key);
 }
 
-// Start a new game for the given player
-int start_new_game(const char *plid, int max_playtime, char *secret_key, char *mode) {
+// Start a new game of the given shape for the player
+int start_new_game(const char *plid, int max_playtime, char *secret_key, char *mode, int shape) {
+    int key = plid_key(plid);
+    if (key < 0) return 0;  // Invalid PLID
+
     // Check if the player already has an active game
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (active_games[i].active && strcmp(active_games[i].plid, plid) == 0) {
-            return 0; // Player already has an active game
-        }
-    }
-
-    // Find an empty slot to create a new game
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (!active_games[i].active) {
-            strcpy(active_games[i].plid, plid);
-            strcpy(active_games[i].mode, mode);
-            active_games[i].max_playtime = max_playtime;
-            active_games[i].trials = 0;
-            active_games[i].active = 1;
-            active_games[i].start_time = time(NULL); // Record the start time
-            if (strlen(secret_key) == 0){
-                generate_secret_key(active_games[i].secret_key);
-                strcpy(secret_key, active_games[i].secret_key);
-            }
-            else{
-                strcpy(active_games[i].secret_key, secret_key);
-                snprintf(formatted_key, 10, "%c %c %c %c", secret_key[0], secret_key[1], secret_key[2], secret_key[3]);
-                formatted_key[7] = '\0';
-            }
-            return 1;
-        }
+    if (game_table_find(active_games, key)) {
+        return 0; // Player already has an active game
+    }
+
+    // Create the new game in the shard's table
+    Game *game = game_table_insert(active_games, key);
+    if (!game) return 0;    // Out of memory
+
+    game->debug = mode[0] == 'D';
+    game->shape = shape;
+    game->trials = 0;
+    game->active = 1;
+    game->start = game_time(time(NULL)); // Record the start time
+    game->deadline = game->start + max_playtime;
+    // The game times out once more than max_playtime seconds have elapsed
+    if (timer_wheel_add(game_timers, game_slot(active_games, game), game_deadline(game) + 1) < 0) {
+        game_table_remove(active_games, key);
+        return 0;   // Out of memory
     }
-    return 0; // No available slots
+    if (strlen(secret_key) == 0){
+        generate_secret_key(secret_key, shape);
+        game->secret = code_index(shape, secret_key);
+    }
+    else{
+        game->secret = code_index(shape, secret_key);
+        format_secret_key(secret_key, formatted_key);
+    }
+    return 1;
 }
 
 // Utility function to format the secret_key with spaces between each character
+// (formatted_key holds SECRET_KEY_SIZE bytes)
 void format_secret_key(const char *secret_key, char *formatted_key) {
-    snprintf(formatted_key, 10, "%c %c %c %c", secret_key[0], secret_key[1], secret_key[2], secret_key[3]);
-    formatted_key[7] = '\0'; // Null-terminate to avoid garbage data
+    int n = 0;
+    for (int i = 0; secret_key[i] && i < MAX_PEGS; i++) {
+        if (i > 0) formatted_key[n++] = ' ';
+        formatted_key[n++] = secret_key[i];
+    }
+    formatted_key[n] = '\0'; // Null-terminate to avoid garbage data
 }
 
+// Format the secret key of a game, to reveal it when the game ends
+void reveal_secret_key(const Game *game, char *formatted_key) {
+    char code[MAX_PEGS + 1];
+    code_colors(game->shape, game->secret, code);
+    format_secret_key(code, formatted_key);
+}
 
-// Process a player's guess and update the game state
-int process_guess(const char *plid, const char *guess, int nT, int *nB, int *nW, char *secret_key) {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (active_games[i].active && strcmp(active_games[i].plid, plid) == 0) {
-
-            *nB = *nW = 0;
-            int color_counts[6] = {0};
-            const char colors[] = "RGBYOP";
-
-            // Check elapsed time
-            time_t current_time = time(NULL);
-            int elapsed_time = (int)difftime(current_time, active_games[i].start_time);
 
-            if (verbose) {printf("Player: %s, Start Time: %ld, Current Time: %ld, Elapsed Time: %d seconds\n", 
-                   plid, active_games[i].start_time, current_time, elapsed_time);}
+// Process a player's guess and update the game state
+int process_guess(const UdpRequest *req, int *nB, int *nW, char *secret_key) {
+    const char *plid = req->plid, *guess = req->colors;
+    int nT = req->trial;
 
-            if (difftime(current_time, active_games[i].start_time) > active_games[i].max_playtime) {
-                active_games[i].active = 0; // End the game
-                format_secret_key(active_games[i].secret_key, secret_key);
-                return -5; // Time exceeded
-            }
+    Game *game = game_table_find(active_games, req->key);
+    if (!game || !game->active) {
+        return -4; // NOK: No active game found
+    }
 
-            // Validate PLID
-            if (strlen(plid) != 6 || strspn(plid, "0123456789") != 6) {
-                return -1; // ERR: Invalid PLID
-            }
+    *nB = *nW = 0;
 
-            // Validate the color codes in the guess
-            for (int i = 0; i < 4; i++) {
-                if (!strchr(colors, guess[i])) {
-                    return -1; // ERR: Invalid color code
-                }
-            }
+    // Check elapsed time
+    time_t current_time = time(NULL);
+    int elapsed_time = (int)difftime(current_time, game_start(game));
 
-            /**
-             * TODO: 
-             *  - Resend scenario
-            */
+    if (verbose) {vlog("Player: %s, Start Time: %ld, Current Time: %ld, Elapsed Time: %d seconds\n", 
+           plid, (long)game_start(game), current_time, elapsed_time);}
 
-            if (nT != active_games[i].trials + 1) {
-                if (nT == active_games[i].trials &&
-                    strcmp(active_games[i].guesses[active_games[i].trials - 1], guess) == 0) {
-                    return 0; // OK: Resending the last valid guess
-                }
-                return -2; // INV: Invalid trial number
-            }
+    if (current_time > game_deadline(game)) {
+        game->active = 0; // End the game
+        reveal_secret_key(game, secret_key);
+        return -5; // Time exceeded
+    }
 
-            for (int j = 0; j < active_games[i].trials; j++) {
-                if (strcmp(active_games[i].guesses[j], guess) == 0) {
-                    return -3; // DUP: Duplicate guess
-                }
-            }
+    // The guess must be a code of the game's shape
+    if (req->shape != (int)game->shape) {
+        return -6; // INV: Not a code of this game
+    }
 
-            for (int j = 0; j < 4; j++) {
-                if (guess[j] == active_games[i].secret_key[j]) {
-                    (*nB)++;
-                } else {
-                    for (int k = 0; k < 6; k++) {
-                        if (active_games[i].secret_key[j] == colors[k]) {
-                            color_counts[k]++;
-                            break;
-                        }
-                    }
-                }
-            }
+    GameHistory *history = game_history(active_games, game);
+    if (nT != game->trials + 1) {
+        // Resent last guess whose reply fell out of the reply cache: score it again
+        if (nT == game->trials && nT > 0 && history->guesses[game->trials - 1] == (uint32_t)req->code) {
+            uint8_t result = shape_feedback(game->shape, game->secret, req->code);
+            *nB = FEEDBACK_NB(result);
+            *nW = FEEDBACK_NW(result);
+            return 0; // OK: Resending the last valid guess
+        }
+        return -2; // INV: Invalid trial number
+    }
 
-            for (int j = 0; j < 4; j++) {
-                if (guess[j] != active_games[i].secret_key[j]) {
-                    for (int k = 0; k < 6; k++) {
-                        if (guess[j] == colors[k] && color_counts[k] > 0) {
-                            (*nW)++;
-                            color_counts[k]--;
-                            break;
-                        }
-                    }
-                }
-            }
+    for (int j = 0; j < game->trials; j++) {
+        if (history->guesses[j] == (uint32_t)req->code) {
+            return -3; // DUP: Duplicate guess
+        }
+    }
 
-            strncpy(active_games[i].guesses[active_games[i].trials], guess, 4);
-            active_games[i].guesses[active_games[i].trials][4] = '\0';
-            active_games[i].trials++;
-            add_trial(plid, guess, *nB, *nW, elapsed_time); // Pass the start time
+    // Score the guess with the kernel of the game's shape (the precomputed table for 4 x 6)
+    uint8_t result = shape_feedback(game->shape, game->secret, req->code);
+    *nB = FEEDBACK_NB(result);
+    *nW = FEEDBACK_NW(result);
 
-            if (*nB == 4) {
-                active_games[i].active = 0;
-                return 1; // Game won
-            }
+    history->guesses[game->trials++] = req->code;
+    add_trial(plid, game->trials, guess, *nB, *nW, elapsed_time); // Pass the start time
 
-            if (active_games[i].trials >= MAX_ATTEMPTS) {
-                active_games[i].active = 0;
-                format_secret_key(active_games[i].secret_key, secret_key);
-                return 2; // Game over: Maximum attempts reached
-            }
+    if (*nB == game_shapes[game->shape].pegs) {
+        game->active = 0;
+        return 1; // Game won
+    }
 
-            return 0; // OK: Valid guess
-        }
+    if (game->trials >= MAX_ATTEMPTS) {
+        game->active = 0;
+        reveal_secret_key(game, secret_key);
+        return 2; // Game over: Maximum attempts reached
     }
 
-    return -4; // NOK: No active game found
+    return 0; // OK: Valid guess
 }
 
 // Handle the quit command
 void quit_game(const char *plid, char *response) {
-    char secret_key[10];
-    int game_found = 0;
-
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (active_games[i].active && strcmp(active_games[i].plid, plid) == 0) {
-            game_found = 1;
-            active_games[i].active = 0;
-            finish_game(plid, "Q"); // Finalize the game using finish_game with "Q" for quit
-            format_secret_key(active_games[i].secret_key, secret_key);
-            snprintf(response, BUFFER_SIZE, "RQT OK %s\n", secret_key);
-            return;
-        }
-    }
-    if (!game_found) {
+    char secret_key[SECRET_KEY_SIZE];
+    Game *game = get_game(plid);
+
+    if (game) {
+        game->active = 0;
+        reveal_secret_key(game, secret_key);
+        finish_game(plid, "Q"); // Finalize the game using finish_game with "Q" for quit (releases it)
+        snprintf(response, BUFFER_SIZE, "RQT OK %s\n", secret_key);
+    } else {
         snprintf(response, BUFFER_SIZE, "RQT NOK\n"); // No active game found
     }
 }
 
-// Handle incoming UDP messages
-void handle_udp_message(int udp_socket, struct sockaddr_in *client_addr, socklen_t client_len, char *buffer) {
-    char response[BUFFER_SIZE];
-    memset(response, 0, BUFFER_SIZE);
-    char secret_key[5] = {0};
-    char plid[7];
-    int max_playtime;
-    char c1, c2, c3, c4;
+// Handle an incoming UDP message and build its reply (BUFFER_SIZE bytes); returns the reply length
+int handle_udp_message(char *buffer, char *response) {
+    char secret_key[SECRET_KEY_SIZE] = {0};
+    UdpRequest req;
+    int nB, nW;
+
+    parse_udp_request(buffer, &req);
+
+    // A retransmission of the player's last request gets the original reply
+    int cacheable = req.status == PARSE_OK;
+    uint64_t digest = 0;
+    if (cacheable) {
+        digest = reply_digest(buffer, strlen(buffer));
+        int len = reply_cache_lookup(reply_cache, req.key, digest, response);
+        if (len > 0) {
+            counter_add(&shard_metrics->replayed, 1);
+            if (verbose) vlog("Replayed response: %s\n", response);
+            return len;
+        }
+    }
 
-    /*============= Parse and handle the message based on the command type =============*/ 
-    
+    /*============= Handle the message based on the command type =============*/ 
+
+    switch (req.type) {
     // ------------------ Start New Game ------------------
-    if (strncmp(buffer, "SNG", 3) == 0) {   
-        char plid[7];
-
-        if (sscanf(buffer, "SNG %6s %3d", plid, &max_playtime) == 2) {
-            if (max_playtime > MAX_PLAYTIME) {
-                snprintf(response, sizeof(response), "RSG ERR\n");  // Invalid playtime
-            } else if (start_new_game(plid, max_playtime, secret_key, "PLAY")) {
-                create_game_file(plid, 'P', secret_key, max_playtime);  // Create the game file
-                snprintf(response, sizeof(response), "RSG OK\n");   // Game started successfully
-            } else {
-                snprintf(response, sizeof(response), "RSG NOK\n");  // Failed to start game
-            }
+    case REQ_SNG:
+        if (req.status != PARSE_OK) {
+            snprintf(response, BUFFER_SIZE, "RSG ERR\n");      // Invalid syntax, PLID or playtime
+        } else if (start_new_game(req.plid, req.max_playtime, secret_key, "PLAY", req.shape)) {
+            create_game_file(req.plid, 'P', secret_key, req.max_playtime);  // Create the game file
+            snprintf(response, BUFFER_SIZE, "RSG OK\n");       // Game started successfully
         } else {
-            snprintf(response, sizeof(response), "RSG ERR\n");      // Invalid syntax
+            snprintf(response, BUFFER_SIZE, "RSG NOK\n");      // Failed to start game
         }
+        break;
 
     // ------------------ Try command ------------------
-    } else if (strncmp(buffer, "TRY", 3) == 0) {    
-
-        char plid[7], c1, c2, c3, c4;
-        int nB, nW, nT;
+    case REQ_TRY:
+        if (req.status == PARSE_INV) {
+            snprintf(response, BUFFER_SIZE, "RTR INV\n");      // Invalid format or colors
+            break;
+        }
+        if (req.status != PARSE_OK) {
+            snprintf(response, BUFFER_SIZE, "RTR ERR\n");      // Invalid syntax
+            break;
+        }
 
-        if (sscanf(buffer, "TRY %6s %c %c %c %c %d", plid, &c1, &c2, &c3, &c4, &nT) == 6) {
+        switch (process_guess(&req, &nB, &nW, secret_key)) {
+            case 0: // OK: Valid guess
+                snprintf(response, BUFFER_SIZE, "RTR OK %d %d %d\n", req.trial, nB, nW);
+                break;
 
-            // Ensure the format is valid (check spaces and colors)
-            if (buffer[10] != ' ' || buffer[12] != ' ' || buffer[14] != ' ' || buffer[16] != ' ' || buffer[18] != ' ') {
-                snprintf(response, sizeof(response), "RTR INV\n"); // Invalid format
+            case 1: // Game won
+                finish_game(req.plid, "W");  // Finalize the game with "W" (Win)
+                snprintf(response, BUFFER_SIZE, "RTR OK %d %d %d\n", req.trial, nB, nW);
+                break;
 
-            } else if (!strchr("RGBYOP", c1) || !strchr("RGBYOP", c2) || !strchr("RGBYOP", c3) || !strchr("RGBYOP", c4)) {
-                snprintf(response, sizeof(response), "RTR INV\n");
+            case 2: // Game over: Maximum attempts reached
+                finish_game(req.plid, "F");  // Finalize the game with "F" (Fail)
+                snprintf(response, BUFFER_SIZE, "RTR ENT %s\n", secret_key);
+                break;
 
-            } else {
-                // Compact the guess into a single string
-                char guess[5] = {c1, c2, c3, c4, '\0'};
-
-                int result = process_guess(plid, guess, nT, &nB, &nW, secret_key);
-
-                switch (result) {
-                    case 0: // OK: Valid guess
-                        snprintf(response, sizeof(response), "RTR OK %d %d %d\n", nT, nB, nW);
-                        break;
-
-                    case 1: // Game won
-                        finish_game(plid, "W");  // Finalize the game with "W" (Win)
-                        snprintf(response, sizeof(response), "RTR OK %d %d %d\n", nT, nB, nW);
-                        break;
-
-                    case 2: // Game over: Maximum attempts reached
-                        finish_game(plid, "F");  // Finalize the game with "F" (Fail)
-                        snprintf(response, sizeof(response), "RTR ENT %s\n", secret_key);
-                        break;
-
-                    case -1: // ERR: Invalid guess
-                        snprintf(response, sizeof(response), "RTR ERR\n");
-                        break;
-
-                    case -2: // INV: Invalid trial number
-                        snprintf(response, sizeof(response), "RTR INV\n");
-                        break;
-
-                    case -3: // DUP: Duplicate guess
-                        snprintf(response, sizeof(response), "RTR DUP\n");
-                        break;
-
-                    case -4: // NOK: No active game found
-                        snprintf(response, sizeof(response), "RTR NOK\n");
-                        break;
-                    
-                    case -5: // ETM: Time exceeded
-                        finish_game(plid, "T");  // Finalize the game with "T" (Timeout)
-                        snprintf(response, sizeof(response), "RTR ETM %s\n", secret_key); 
-                        break; 
-
-                    default:
-                        snprintf(response, sizeof(response), "RTR ERR\n");
-                        break;
-                }
-            }
-        } else {
-            // Invalid syntax
-            snprintf(response, sizeof(response), "RTR ERR\n");
-        }
+            case -2: // INV: Invalid trial number
+            case -6: // INV: Guess of another shape than the game's
+                snprintf(response, BUFFER_SIZE, "RTR INV\n");
+                break;
 
-    // ------------------ Quit Game ------------------
-    } else if (strncmp(buffer, "QUT", 3) == 0) {   
-        char plid[7];
+            case -3: // DUP: Duplicate guess
+                snprintf(response, BUFFER_SIZE, "RTR DUP\n");
+                break;
 
-        /**
-         * TODO:
-         *  - If PLID did not have an ongoing game, the GS replies with status = NOK
-         */
+            case -4: // NOK: No active game found
+                snprintf(response, BUFFER_SIZE, "RTR NOK\n");
+                break;
+            
+            case -5: // ETM: Time exceeded
+                finish_game(req.plid, "T");  // Finalize the game with "T" (Timeout)
+                snprintf(response, BUFFER_SIZE, "RTR ETM %s\n", secret_key); 
+                break; 
 
-        if (sscanf(buffer, "QUT %6s", plid) == 1) {
-            snprintf(response, sizeof(response), "RQT OK %s\n", formatted_key); 
-            quit_game(plid, response);  // Process quit request
+            default:
+                snprintf(response, BUFFER_SIZE, "RTR ERR\n");
+                break;
+        }
+        break;
 
+    // ------------------ Quit Game ------------------
+    case REQ_QUT:
+        if (req.status == PARSE_OK) {
+            quit_game(req.plid, response);  // Process quit request
         } else {
-            snprintf(response, sizeof(response), "RQT ERR\n");   // Invalid syntax
+            snprintf(response, BUFFER_SIZE, "RQT ERR\n");   // Invalid syntax
         }
+        break;
 
     // ------------------ Debug command ------------------
-    } else if (sscanf(buffer, "DBG %6s %d %c %c %c %c", plid, &max_playtime, &c1, &c2, &c3, &c4) == 6) {
-
-        char key[5] = {c1, c2, c3, c4, '\0'};
-        //int res = processDebug(plid, &max_playtime, guess, secret_key) implement processDebug on another aux file to clean the code
-        //switch (res) {
-            // Invalid PLID/playtime/color codes
-        //    case -1:
-        //        snprintf(response, sizeof(response), "RDB ERR\n");
-        //        break;
-            
-            // Player already has an ongoing game OR Failed to start the game
-        //    case 0:
-        //        snprintf(response, sizeof(response), "RDB NOK\n");
-        //        break;
-
-            // Game successfully started
-        //    case 1:
-        //        snprintf(response, sizeof(response), "RDB OK\n");
-        //        break;
-
-        //    default:
-        //        snprintf(response, sizeof(response), "RTR ERR\n");
-        //        break;
-        //}
-
-        // Validate the PLID
-        if (strlen(plid) != 6 || strspn(plid, "0123456789") != 6) {
-            snprintf(response, sizeof(response), "RDB ERR\n");  // Invalid PLID
-        }
-
-        // Validate max_playtime
-        else if (max_playtime <= 0 || max_playtime > MAX_PLAYTIME) {
-            snprintf(response, sizeof(response), "RDB ERR\n");  // Invalid playtime
-        }
-
-        // Validate the colors
-        else if (!strchr("RGBYOP", c1) || !strchr("RGBYOP", c2) || !strchr("RGBYOP", c3) || !strchr("RGBYOP", c4)) {
-            snprintf(response, sizeof(response), "RDB ERR\n");  // Invalid color codes
-        }
-        
-        // Check for an existing game
-        else {
-            int game_exists = 0;
-            for (int i = 0; i < MAX_CLIENTS; i++) {
-                if (active_games[i].active && strcmp(active_games[i].plid, plid) == 0) {
-                    game_exists = 1;
-                    break;
-                }
-            }
-
-            if (game_exists) {
-                snprintf(response, sizeof(response), "RDB NOK\n");  // Player already has an ongoing game
-
-            } else {
-                // Create a new game with the specified secret key
-                if (start_new_game(plid, max_playtime, key, "DEBUG")) {
-                    create_game_file(plid, 'D', key, max_playtime);  // Create the game file
-                    snprintf(response, sizeof(response), "RDB OK\n");  // Game successfully started
-                } else {
-                    snprintf(response, sizeof(response), "RDB NOK\n");  // Failed to start the game
-                }
-            }
+    case REQ_DBG:
+        if (req.status != PARSE_OK) {
+            snprintf(response, BUFFER_SIZE, "RDB ERR\n");  // Invalid syntax, PLID, playtime or colors
+        } else if (get_game(req.plid)) {
+            snprintf(response, BUFFER_SIZE, "RDB NOK\n");  // Player already has an ongoing game
+        } else if (start_new_game(req.plid, req.max_playtime, req.colors, "DEBUG", req.shape)) {
+            // Create a new game with the specified secret key
+            create_game_file(req.plid, 'D', req.colors, req.max_playtime);  // Create the game file
+            snprintf(response, BUFFER_SIZE, "RDB OK\n");   // Game successfully started
+        } else {
+            snprintf(response, BUFFER_SIZE, "RDB NOK\n");  // Failed to start the game
         }
+        break;
 
-    } else {
-        snprintf(response, sizeof(response), "ERR\n");  // Unknown command
+    default:
+        snprintf(response, BUFFER_SIZE, "ERR\n");  // Unknown command
+        break;
     }
 
-    // Send the response back to the client
-    sendto(udp_socket, response, strlen(response), 0, (struct sockaddr*)client_addr, client_len);
-    if (verbose) printf("Sent response: %s\n", response);
-}
+    int len = strlen(response);
+    if (cacheable) reply_cache_store(reply_cache, req.key, digest, response, len);
 
-// Handle incoming TCP connections
-void handle_tcp_connection(int client_socket) {
-    char buffer[BUFFER_SIZE];
-    memset(buffer, 0, BUFFER_SIZE);
+    if (verbose) vlog("Sent response: %s\n", response);
+    return len;
+}
 
-    // Read the client's message
-    read(client_socket, buffer, BUFFER_SIZE);
-    if (verbose) printf("Received TCP message: %s\n", buffer);
+// Parse a buffered TCP request and build the reply in the connection's output buffer
+void handle_tcp_request(Connection *conn) {
+    char *buffer = conn->in_buf;
 
     // Variable to store extracted PLID
     char plid[7]; // 6 characters + null terminator
     memset(plid, 0, sizeof(plid));
 
     // ------------------ Show trials ------------------
-    if (strncmp(buffer, "STR", 3) == 0) {   
-        // char trials[1024];
-        // get_trials("123456", trials); // Replace "123456" with the logic to extract PLID
-        // write(client_socket, trials, strlen(trials));   // Send the trial summary
-    }
-    // FIXME!!! Not sure about this resolution
     if (strncmp(buffer, "STR", 3) == 0) {
         // Extract PLID from the message
         if (sscanf(buffer, "STR %6s", plid) == 1) {
-            char trials[1024];
-            get_trials(plid, trials); // Use the extracted PLID
-            write(client_socket, trials, strlen(trials)); // Send the trial summary
+            get_trials(plid, conn); // Use the extracted PLID
         } else {
-            write(client_socket, "RST NOK\n", 8); // Invalid syntax
+            strcpy(conn->out_buf, "RST NOK\n"); // Invalid syntax
         }
     // ------------------ Show Scoreboard ------------------
     } else if (strncmp(buffer, "SSB", 3) == 0) {   
-        char scores[1024];
-        get_scoreboard(scores); // Generate scoreboard data
-        write(client_socket, scores, strlen(scores));
+        get_scoreboard(conn->out_buf); // Generate scoreboard data
+
+    // ------------------ Metrics (local admin) ------------------
+    } else if (strncmp(buffer, "MET", 3) == 0) {
+        get_metrics(conn);
+
+    // ------------------ Keep-alive (opt-in) ------------------
+    } else if (strncmp(buffer, "KAL", 3) == 0) {
+        // Later requests on this connection are served in order until it is idle or closed
+        conn->keep_alive = 1;
+        sprintf(conn->out_buf, "RKA OK %d\n", TCP_IDLE_TIMEOUT);
 
     } else {
-        write(client_socket, "ERR\n", 4);   // Unknown command
+        strcpy(conn->out_buf, "ERR\n");   // Unknown command
     }
 
-    close(client_socket);// Close the socket for both reading and writing
+    conn->out_len = strlen(conn->out_buf);
+    conn->out_off = 0;
 }
 
 // Generate a trial summary for a given player (PLID)
-void get_trials(const char *plid, char *buffer) {
-    int game = get_game(plid);
-    char fname[100], formatted_fname[25];
-    char line[100];
-    strcpy(buffer, "\0");
-    if (game == -1){ 
-        if (verbose) printf("No active game found for player %s, using last game\n", plid);
-        if(!find_last_game(plid, fname)) {
-            if (verbose) printf("No game found for player %s\n", plid);
-            sprintf(buffer, "RST NOK\n");
-            return;
-        }
-        sscanf(fname, "GAMES/%*s/%s", formatted_fname);
-        FILE *file = fopen(fname, "r");
-        if (!file) {
-            perror("Failed to open game file for reading");
+// Runs on the TCP thread, which does not own any game shard: an ongoing game is
+// recognised by its GAME_<PLID>.txt file, which is renamed as soon as the game ends.
+void get_trials(const char *plid, Connection *conn) {
+    char fname[100];
+    int active = 1;
+    struct stat st;
+
+    // The files must show every event the player's worker had logged when the request arrived
+    // (a TRY is logged before it is answered): until the materializer has applied them, wait
+    int key = plid_key(plid);
+    if (key >= 0 && conn->state != CONN_WAITING) {
+        conn->wait_shard = key % n_workers;
+        conn->wait_for = atomic_load(&workers[conn->wait_shard].log_ring.head);
+        if (!conn_caught_up(conn)) {
+            conn->state = CONN_WAITING;
+            conn->out_buf[0] = '\0';
             return;
         }
-        fseek(file, 0L, SEEK_END);
-        long int size = ftell(file);
-        rewind(file);
-        sprintf(buffer, "RST FIN %s %ld ", fname, size);
-        while (fgets(line, sizeof(line), file))
-            strcat(buffer, line);
+    }
 
-        fclose(file);
-    } else {
-        if (verbose) printf("Active game found for player %s\n", plid);
-        sprintf(formatted_fname, "GAME_%s.txt", plid);
-        sprintf(fname, "GAMES/%s/GAME_%s.txt", plid, plid);
-        FILE *file = fopen(fname, "r");
-        if (!file) {
-            perror("Failed to open game file for reading");
+    // The active game, unless it was already archived
+    sprintf(fname, "GAMES/%s/GAME_%s.txt", plid, plid);
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        if (verbose) vlog("No active game found for player %s, using last game\n", plid);
+        if(!find_last_game(plid, fname) || (fd = open(fname, O_RDONLY)) < 0) {
+            if (verbose) vlog("No game found for player %s\n", plid);
+            sprintf(conn->out_buf, "RST NOK\n");
             return;
         }
-        fseek(file, 0L, SEEK_END);
-        long int size = ftell(file);
-        rewind(file);
-        sprintf(buffer, "RST ACT %s %ld ", formatted_fname, size);
-        while (fgets(line, sizeof(line), file)) 
-            strcat(buffer, line);
-
-        fclose(file);
+        active = 0;
+    } else {
+        if (verbose) vlog("Active game found for player %s\n", plid);
     }
-}
 
-// Generate the scoreboard
-void get_scoreboard(char *buffer) {
-    Scorelist list;
-    if(!find_top_scores(&list)) {
-        if (verbose) printf("No scores found\n");
-        sprintf(buffer, "RSS EMPTY\n"); 
-        return;
-    }
-    if (verbose) printf("Scores found\n");
-    char line[100];
-    FILE *scoreboard_file = fopen("SCORES/scoreboard.txt", "w");
-    if (!scoreboard_file) {
-        perror("Failed to create scoreboard file");
-        sprintf(buffer, "RSS ERR\n");
+    if (fstat(fd, &st) < 0) {
+        perror("Failed to stat game file");
+        close(fd);
+        sprintf(conn->out_buf, "RST NOK\n");
         return;
     }
 
-    for (int i = 0; i < list.n_scores; i++) {
-        fprintf(scoreboard_file, "%03d %s %s %d %s\n", list.score[i], list.plid[i], list.secret_key[i], list.no_trials[i], list.mode[i]);
+    // Only the header is built here; the body is sent with sendfile() by conn_write
+    if (active) {
+        sprintf(conn->out_buf, "RST ACT GAME_%s.txt %ld ", plid, (long)st.st_size);
+    } else {
+        sprintf(conn->out_buf, "RST FIN %s %ld ", fname, (long)st.st_size);
     }
-    fclose(scoreboard_file);
+    conn->file_fd = fd;
+    conn->file_off = 0;
+    conn->file_len = st.st_size;
+}
+
+// Current time for latency measurements (ns)
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-    // Read the scoreboard file to send its content
-    scoreboard_file = fopen("SCORES/scoreboard.txt", "r");
-    if (!scoreboard_file) {
-        perror("Failed to open scoreboard file for reading");
-        sprintf(buffer, "RSS ERR\n");
+// Sum the counters of every worker and of the TCP loop into a metrics document (local clients only)
+void get_metrics(Connection *conn) {
+    struct sockaddr_in peer;
+    socklen_t len = sizeof(peer);
+    Metrics *blocks[MAX_WORKERS + 1];
+    char document[TCP_BUFFER_SIZE - 64];
+
+    if (getpeername(conn->fd, (struct sockaddr *)&peer, &len) < 0 || peer.sin_family != AF_INET ||
+        (ntohl(peer.sin_addr.s_addr) >> 24) != 127) {
+        strcpy(conn->out_buf, "RMT NOK\n");   // Not from this host
         return;
     }
 
-    fseek(scoreboard_file, 0L, SEEK_END);
-    long int size = ftell(scoreboard_file);
-    rewind(scoreboard_file);
-
-    sprintf(buffer, "RSS OK scoreboard.txt %ld ", size);
-    while (fgets(line, sizeof(line), scoreboard_file)) {
-        strcat(buffer, line);
+    for (int i = 0; i < n_workers; i++) blocks[i] = &workers[i].metrics;
+    blocks[n_workers] = &tcp_metrics;
+    int size = metrics_format(blocks, n_workers + 1, document, sizeof(document));
+    if (size < (int)sizeof(document)) {
+        size += snprintf(document + size, sizeof(document) - size,
+                         "# TYPE gs_vlog_dropped_total counter\ngs_vlog_dropped_total %lu\n",
+                         (unsigned long)vlog_dropped());
+        if (size >= (int)sizeof(document)) size = sizeof(document) - 1;
     }
-    fclose(scoreboard_file);
 
+    int header = sprintf(conn->out_buf, "RMT OK metrics.txt %d ", size);
+    memcpy(conn->out_buf + header, document, size + 1);
 }
 
-int get_game(const char *plid) {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (active_games[i].active && strcmp(active_games[i].plid, plid) == 0) {
-            return i;
-        }
-    }
-    return -1;
+// Generate the scoreboard
+void get_scoreboard(char *buffer) {
+    scoreboard_response(buffer, TCP_BUFFER_SIZE);
+    if (verbose) vlog("%s\n", strncmp(buffer, "RSS OK", 6) == 0 ? "Scores found" : "No scores found");
+}
+
+// Active game of a player in the calling worker's shard, or NULL
+Game *get_game(const char *plid) {
+    int key = plid_key(plid);
+    if (key < 0) return NULL;
+
+    Game *game = game_table_find(active_games, key);
+    return (game && game->active) ? game : NULL;
 }
 
 int find_last_game(const char *plid, char* fname) {
     struct dirent **filelist;
     int n_entries, found;
-    char dirname[20];
+    char dirname[20], name[28];
+
+    // O(1) through the player index
+    if (player_index_lookup(plid, name, NULL)) {
+        sprintf(fname, "GAMES/%s/%s", plid, name);
+        return 1;
+    }
 
+    // Not indexed (or no index): scan the player's directory
     sprintf(dirname, "GAMES/%s", plid);
     n_entries = scandir(dirname, &filelist, 0, alphasort);
 
@@ -861,35 +2264,3 @@ int find_last_game(const char *plid, char* fname) {
     free(filelist);
     return found;
 }
-
-int find_top_scores(Scorelist *list){
-    struct dirent **filelist;
-    int n_entries, i_file;
-    char fname[300];
-    FILE *file;
-
-    n_entries = scandir("SCORES", &filelist, 0, alphasort);
-
-    if (n_entries <= 0)
-        return 0;
-
-    i_file = 0;
-    while(n_entries--){
-        if (filelist[n_entries]->d_name[0] != '.' && i_file < 10){
-            sprintf(fname, "SCORES/%s", filelist[n_entries]->d_name);
-            file = fopen(fname, "r");
-            if (!file) {
-                perror("Failed to open score file for reading");
-                return 0;
-            }
-            fscanf(file, "%d %s %s %d %s", &list->score[i_file], list->plid[i_file], list->secret_key[i_file], &list->no_trials[i_file], list->mode[i_file]);
-            fclose(file);
-            i_file++;
-        } 
-        free(filelist[n_entries]);
-    }
-    
-    free(filelist);
-    list->n_scores = i_file;
-    return(i_file);
-}
\ No newline at end of file
@@ -8,48 +8,168 @@
 #include <netinet/in.h>
 #include <time.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "game_table.h"
+#include "timer_wheel.h"
+#include "feedback.h"
+#include "wal.h"
+#include "scoreboard.h"
+#include "player_index.h"
+#include "recovery.h"
+#include "protocol.h"
+#include "metrics.h"
+#include "reply_cache.h"
+#include "log_ring.h"
+#include "uring.h"
+#include "vlog.h"
+#include "snapshot.h"
 
 #define PORT 58053
-#define MAX_CLIENTS 10
+#define MAX_CLIENTS 10          // Game slots of the old single-threaded servers (tcp_gs.c, udp_gs.c)
+#define TCP_BACKLOG SOMAXCONN   // Pending TCP connections (listen backlog, capped by net.core.somaxconn)
 #define BUFFER_SIZE 256
-#define MAX_ATTEMPTS 8
-#define MAX_PLAYTIME 600
+#define MAX_ATTEMPTS GAME_MAX_TRIALS
+#define SECRET_KEY_SIZE (2 * MAX_PEGS)  // Revealed secret key ("C C C C"), terminator included
+#define MAX_EVENTS 64
+#define TCP_BUFFER_SIZE 8192      // Reply header or whole reply (metrics document included)
+#define TCP_IDLE_TIMEOUT 30     // Seconds a TCP connection may stay without traffic
+#define MAX_WORKERS 64
+#define UDP_BATCH 32            // Default datagrams per recvmmsg/sendmmsg
+#define MAX_UDP_BATCH 1024
+#define URING_ENTRIES 512       // Submission queue size of the io_uring backend
+#define URING_RECV_BUFFERS 256  // Provided receive buffers (power of two)
+#define URING_SEND_SLOTS 512    // Replies in flight (more than the receive buffers)
+#define SNAPSHOT_POLL_MS 100    // How often the main loop checks on a snapshot child still writing
 
 // Structs
+// Receive/reply vectors for batched datagram I/O
+typedef struct {
+    int size;                       // Max datagrams per recvmmsg/sendmmsg call
+    struct mmsghdr *rx, *tx;
+    struct iovec *rx_iov, *tx_iov;
+    struct sockaddr_in *addrs;      // Sender of each request (and destination of its reply)
+    char (*requests)[BUFFER_SIZE];
+    char (*responses)[BUFFER_SIZE];
+    char (*controls)[CMSG_SPACE(sizeof(uint32_t))];  // SO_RXQ_OVFL drop counter of each receive
+} UdpBatch;
+
+// Reply in flight on the io_uring backend (kept until its send completes)
 typedef struct {
-    int max_playtime;      // Maximum playtime in seconds
-    int trials;            // Number of trials made
-    int active;            // Active game flag (1: active, 0: inactive)
-    time_t start_time;     // Start time of the game
-    char secret_key[5];    // Secret key (4 colors + null terminator)
-    char plid[7];          // Player ID
-    char mode[10];         // store the game mode (PLAY or DEBUG)
-    char guesses[8][5];    // Histórico de até 8 tentativas (4 cores + '\0')
-} Game;
+    struct msghdr msg;
+    struct iovec iov;
+    struct sockaddr_in addr;
+    char response[BUFFER_SIZE];
+} UringSend;
 
+// UDP worker: one SO_REUSEPORT socket and the shard of games whose PLIDs are steered to it
 typedef struct {
-    int n_scores;
-    char plid[10][7];           // Player ID
-    char secret_key[10][5];     // Secret key
-    int score[10];              // Game score
-    int no_trials[10];          // Number of trials made in the game
-    char mode[10][6];               // Game mode (PLAY or DEBUG)
-} Scorelist;
+    int id;                         // Worker index (socket index in the reuseport group)
+    pthread_t thread;
+    int udp_socket;
+    UdpBatch batch;                 // Batched I/O buffers
+    GameTable games;                // Games owned by this worker
+    TimerWheel timers;              // Expiry timers of those games
+    ReplyCache replies;             // Last reply to each of those players, for retransmissions
+    LogRing log_ring;               // Log records on their way to the log writer
+    Wal wal;                        // Write-ahead log of the shard (written by the log writer)
+    Metrics metrics;                // Counters and latency histograms of this worker
+    _Atomic uint64_t materialized;  // Records of this run applied to the files (compared with the ring's head)
+} Worker;
+
+// States of a non-blocking TCP connection
+typedef enum {
+    CONN_READING,   // Waiting for the full request line (or the next one, on a keep-alive connection)
+    CONN_WAITING,   // STR held until the files show every event the player's worker had logged
+    CONN_WRITING,   // Sending the reply header and file body (possibly across several EPOLLOUT edges)
+    CONN_CLOSED     // Done or failed, to be released
+} ConnState;
+
+typedef struct Connection {
+    int fd;                          // Client socket
+    ConnState state;                 // Current state
+    int keep_alive;                  // Opted in with KAL: serve requests until idle or closed
+    char in_buf[BUFFER_SIZE];        // Request bytes received so far
+    int in_len;
+    char out_buf[TCP_BUFFER_SIZE];   // Reply being sent
+    int out_len;                     // Reply length
+    int out_off;                     // Bytes already written
+    int file_fd;                     // File streamed with sendfile() after the header (-1 if none)
+    off_t file_off;                  // Bytes of the file already sent
+    off_t file_len;                  // Bytes of the file to send
+    uint64_t started;                // When the request was complete (ns, for the latency metrics)
+    int wait_shard;                  // Worker whose records a waiting STR needs in the files...
+    uint64_t wait_for;               // ... and how many of them (its log ring's head at the request)
+    struct Connection *next_waiting; // Next STR held for the materializer
+} Connection;
 
 // Function prototypes
-void initialize_games();
-void generate_secret_key(char *secret_key);
-int start_new_game(const char *plid, int max_playtime, char *secret_key, char *mode);
-int process_guess(const char *plid, const char *guess, int nT, int *nB, int *nW, char *response_buffer);
+void initialize_games(Worker *worker);
+void restore_game(const RecoveredGame *recovered, void *ctx);
+void restore_snapshot(const Snapshot *snapshot);
+void restore_record(const WalRecord *record, int shard, uint64_t position);
+void materialize_leftover(const WalRecord *record, int shard, uint64_t position);
+void expire_game(uint32_t slot, void *ctx);
+void generate_secret_key(char *secret_key, int shape);
+void format_secret_key(const char *secret_key, char *formatted_key);
+void reveal_secret_key(const Game *game, char *formatted_key);
+int start_new_game(const char *plid, int max_playtime, char *secret_key, char *mode, int shape);
+int process_guess(const UdpRequest *req, int *nB, int *nW, char *secret_key);
 void quit_game(const char *plid, char *response);
-void handle_udp_message(int udp_socket, struct sockaddr_in *client_addr, socklen_t client_len, char *buffer);
-void handle_tcp_connection(int client_socket);
-void get_trials(const char *plid, char *buffer);
-void get_scoreboard();
-void create_score_file(const char *plid, const char *code, int trials, const char *mode, int duration, int max_playtime);
+int handle_udp_message(char *buffer, char *response);
+void handle_tcp_request(Connection *conn);
+void get_trials(const char *plid, Connection *conn);
+void get_scoreboard(char *buffer);
+void get_metrics(Connection *conn);
+uint64_t now_ns(void);
+void create_score_file(const char *plid, const char *code, int trials, const char *mode, int duration, int max_playtime, time_t end_time);
 int find_last_game(const char *plid, char* fname);
-int get_game(const char *plid);
-void add_trial(const char *plid, const char *guess, int correct_pos, int wrong_pos, int elapsed_time);
-int find_top_scores(Scorelist *list);
+Game *get_game(const char *plid);
+void add_trial(const char *plid, int trial, const char *guess, int correct_pos, int wrong_pos, int elapsed_time);
+void create_game_file(const char *plid, char mode, const char *code, int max_time);
+void finish_game(const char *plid, const char *end_code);
+void log_record(WalRecord *record);
+void materialize_start(const WalRecord *record, int recovering);
+int game_file_matches(const char *filename, time_t start, const char *secret);
+int count_trials(const char *filename);
+void materialize_trial(const WalRecord *record, int recovering);
+void materialize_finish(const WalRecord *record, int recovering);
+void materialize_record(const WalRecord *record, int recovering);
+void notify_materializer();
+void notify_tcp_waiting(void);
+void *materializer(void *arg);
+void notify_log_writer(void);
+void *log_writer(void *arg);
+void pause_for_snapshot(void);
+int write_snapshot(const uint64_t *positions, const ScoreEntry *scores, int n_scores);
+uint64_t logged_records(void);
+void snapshot_positions(uint64_t *positions);
+void start_snapshot(void);
+void finish_snapshot(int wait);
+int snapshot_timeout(time_t next_snapshot);
+void request_stop(int sig);
+int set_nonblocking(int fd);
+int add_to_epoll(int epoll_fd, int fd, uint32_t events);
+void drain_accept(int tcp_socket, int epoll_fd);
+Connection *conn_new(int fd);
+void conn_close(Connection *conn);
+int conn_read(Connection *conn);
+int conn_write(Connection *conn);
+void conn_next_request(Connection *conn);
+int conn_caught_up(const Connection *conn);
+void conn_wait(Connection *conn);
+void conn_unwait(Connection *conn);
+void resume_waiting(void);
+void expire_connection(uint32_t fd, void *ctx);
+void handle_tcp_event(int fd, uint32_t events);
+int create_udp_socket(int port);
+int attach_plid_steering(int udp_socket, int n_workers);
+void *udp_worker(void *arg);
+int udp_batch_init(UdpBatch *batch, int size);
+void udp_batch_free(UdpBatch *batch);
+int udp_batch_flush(int udp_socket, UdpBatch *batch, int n);
+void drain_udp(Worker *worker);
+int udp_worker_uring(Worker *worker);
 
 #endif
\ No newline at end of file
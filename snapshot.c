@@ -0,0 +1,156 @@
+/*
+ * snapshot.c
+ *
+ * Point-in-time image of the in-memory state of the server: the active games of every worker
+ * shard, the workers' reply caches and the top 10. Restarting from the GAMES/ files costs one
+ * open and parse per active game; restarting from a snapshot is one mmap and a copy of fixed-size
+ * records, followed by the replay of the log records written after it.
+ *
+ * The server takes a snapshot by pausing its workers between two requests and forking: the child
+ * writes its copy-on-write image of the tables with snapshot_write while the workers go on. The
+ * file is written under a temporary name, synced and renamed, so SNAPSHOT_FILE is always whole.
+ *
+ * The player index is not part of the image: it is a mapped file of its own (player_index.c),
+ * which the log replay keeps up to date.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+// Output buffer of snapshot_write (the writer may run in a forked child, where malloc is off limits)
+static char out[1 << 16];
+static size_t out_len;
+
+// Write the whole buffer
+static int flush_out(int fd) {
+    size_t done = 0;
+    while (done < out_len) {
+        ssize_t n = write(fd, out + done, out_len - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += n;
+    }
+    out_len = 0;
+    return 0;
+}
+
+static int put(int fd, const void *data, size_t len) {
+    if (out_len + len > sizeof(out) && flush_out(fd) < 0) return -1;
+    memcpy(out + out_len, data, len);
+    out_len += len;
+    return 0;
+}
+
+// Write every game of a shard, in bucket order
+static int put_games(int fd, const GameTable *table) {
+    RecoveredGame recovered;
+    for (uint32_t b = 0; b < table->capacity; b++) {
+        if (table->buckets[b].key == EMPTY_KEY) continue;
+        uint32_t slot = table->buckets[b].slot;
+        recovered.game = table->games[slot];
+        recovered.history = table->histories[slot];
+        if (put(fd, &recovered, sizeof(recovered)) < 0) return -1;
+    }
+    return 0;
+}
+
+int snapshot_write(const SnapshotShard *shards, int n_shards, const uint64_t *positions,
+                   const ScoreEntry *scores, int n_scores) {
+    SnapshotHeader header;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = SNAPSHOT_MAGIC;
+    header.game_size = sizeof(RecoveredGame);
+    header.reply_size = sizeof(ReplyEntry);
+    header.score_size = sizeof(ScoreEntry);
+    header.taken = time(NULL);
+    memcpy(header.positions, positions, sizeof(header.positions));
+    for (int i = 0; i < n_shards; i++) {
+        header.n_games += shards[i].games->count;
+        for (uint32_t e = 0; e < REPLY_CACHE_SIZE; e++) header.n_replies += shards[i].replies->entries[e].key != EMPTY_KEY;
+    }
+    header.n_scores = n_scores;
+    header.size = sizeof(header) + header.n_games * sizeof(RecoveredGame) +
+                  (uint64_t)header.n_replies * sizeof(ReplyEntry) + (uint64_t)n_scores * sizeof(ScoreEntry);
+
+    int fd = open(SNAPSHOT_TEMP, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    out_len = 0;
+
+    int failed = put(fd, &header, sizeof(header)) < 0;
+    for (int i = 0; i < n_shards && !failed; i++) failed = put_games(fd, shards[i].games) < 0;
+    for (int i = 0; i < n_shards && !failed; i++) {
+        const ReplyEntry *entries = shards[i].replies->entries;
+        for (uint32_t e = 0; e < REPLY_CACHE_SIZE && !failed; e++) {
+            if (entries[e].key != EMPTY_KEY) failed = put(fd, &entries[e], sizeof(ReplyEntry)) < 0;
+        }
+    }
+    if (!failed) failed = put(fd, scores, (size_t)n_scores * sizeof(ScoreEntry)) < 0;
+    if (!failed) failed = flush_out(fd) < 0 || fsync(fd) < 0;
+    close(fd);
+
+    if (failed || rename(SNAPSHOT_TEMP, SNAPSHOT_FILE) < 0) {
+        unlink(SNAPSHOT_TEMP);
+        return -1;
+    }
+
+    // Make the rename durable before any log segment is released
+    int dir = open(WAL_DIR, O_RDONLY | O_DIRECTORY);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+    return 0;
+}
+
+int snapshot_open(Snapshot *snapshot) {
+    struct stat st;
+
+    memset(snapshot, 0, sizeof(*snapshot));
+    int fd = open(SNAPSHOT_FILE, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Failed to map snapshot");
+        return -1;
+    }
+
+    const SnapshotHeader *header = map;
+    if (header->magic != SNAPSHOT_MAGIC || header->game_size != sizeof(RecoveredGame) ||
+        header->reply_size != sizeof(ReplyEntry) || header->score_size != sizeof(ScoreEntry) ||
+        header->size != (uint64_t)st.st_size || header->n_scores > TOP_SCORES ||
+        header->n_games > (header->size - sizeof(SnapshotHeader)) / sizeof(RecoveredGame) ||
+        header->size != sizeof(SnapshotHeader) + header->n_games * sizeof(RecoveredGame) +
+                        (uint64_t)header->n_replies * sizeof(ReplyEntry) + (uint64_t)header->n_scores * sizeof(ScoreEntry)) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    snapshot->map = map;
+    snapshot->size = st.st_size;
+    snapshot->header = header;
+    snapshot->games = (const RecoveredGame *)(header + 1);
+    snapshot->replies = (const ReplyEntry *)(snapshot->games + header->n_games);
+    snapshot->scores = (const ScoreEntry *)(snapshot->replies + header->n_replies);
+    return 0;
+}
+
+void snapshot_close(Snapshot *snapshot) {
+    if (snapshot->map) munmap(snapshot->map, snapshot->size);
+    memset(snapshot, 0, sizeof(*snapshot));
+}
@@ -0,0 +1,72 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "game_table.h"
+#include "recovery.h"
+#include "reply_cache.h"
+#include "scoreboard.h"
+#include "wal.h"
+
+#define SNAPSHOT_FILE WAL_DIR "/snapshot.bin"
+#define SNAPSHOT_TEMP WAL_DIR "/snapshot.tmp"
+#define SNAPSHOT_MAGIC 0x50414E53u          // "SNAP"
+#define SNAPSHOT_INTERVAL 60                // Default seconds between two snapshots
+
+/*
+ * File header, followed by n_games RecoveredGame, n_replies ReplyEntry and n_scores ScoreEntry.
+ * The state is the one reached by applying each shard's log up to its position; a restart
+ * loads it and replays only the records at or after those positions.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t game_size;     // sizeof(RecoveredGame), rejects files of another layout
+    uint32_t reply_size;    // sizeof(ReplyEntry)
+    uint32_t score_size;    // sizeof(ScoreEntry)
+    int64_t taken;          // When the snapshot was taken
+    uint64_t size;          // File size, rejects a truncated file
+    uint64_t positions[WAL_MAX_SHARDS];     // Log position of each shard (see WAL_POSITION)
+    uint64_t n_games;
+    uint32_t n_replies;
+    uint32_t n_scores;
+} SnapshotHeader;
+
+// State of one worker shard, as handed to snapshot_write
+typedef struct {
+    const GameTable *games;
+    const ReplyCache *replies;
+} SnapshotShard;
+
+// A snapshot mapped by snapshot_open
+typedef struct {
+    void *map;
+    size_t size;
+    const SnapshotHeader *header;
+    const RecoveredGame *games;
+    const ReplyEntry *replies;
+    const ScoreEntry *scores;
+} Snapshot;
+
+/**
+ * Write a snapshot of the given shards and top 10 to SNAPSHOT_TEMP, sync it and rename it to
+ * SNAPSHOT_FILE. Only makes system calls (no stdio, no heap), so it can run in a child forked
+ * from the multithreaded server, on its copy-on-write image of the state.
+ *
+ * @param positions log position of every shard (WAL_MAX_SHARDS entries)
+ * @return 0 on success, -1 on error (the previous snapshot is left in place)
+ */
+int snapshot_write(const SnapshotShard *shards, int n_shards, const uint64_t *positions,
+                   const ScoreEntry *scores, int n_scores);
+
+/**
+ * Map the latest snapshot.
+ *
+ * @return 0 on success, -1 if there is none or it is invalid
+ */
+int snapshot_open(Snapshot *snapshot);
+
+void snapshot_close(Snapshot *snapshot);
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * timer_wheel.c
+ *
+ * Hierarchical timing wheel used by the UDP workers to expire games proactively. Arming,
+ * cancelling and firing a timer are O(1), and each tick only touches one level 0 slot (plus
+ * one level 1 slot every 64 ticks), regardless of how many games are in the shard.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "timer_wheel.h"
+
+int timer_wheel_init(TimerWheel *wheel, time_t now) {
+    memset(wheel, 0, sizeof(*wheel));
+    memset(wheel->level0, 0xFF, sizeof(wheel->level0));  // All TIMER_NONE
+    memset(wheel->level1, 0xFF, sizeof(wheel->level1));
+    wheel->current = now;
+    return 0;
+}
+
+void timer_wheel_free(TimerWheel *wheel) {
+    free(wheel->next);
+    free(wheel->prev);
+    free(wheel->head_of);
+    free(wheel->expires);
+    memset(wheel, 0, sizeof(*wheel));
+}
+
+// Make room for ids up to `id`
+static int reserve(TimerWheel *wheel, uint32_t id) {
+    if (id < wheel->cap) return 0;
+
+    uint32_t new_cap = wheel->cap ? wheel->cap : 64;
+    while (new_cap <= id) new_cap *= 2;
+
+    uint32_t *next = realloc(wheel->next, new_cap * sizeof(uint32_t));
+    if (!next) return -1;
+    wheel->next = next;
+    uint32_t *prev = realloc(wheel->prev, new_cap * sizeof(uint32_t));
+    if (!prev) return -1;
+    wheel->prev = prev;
+    time_t *expires = realloc(wheel->expires, new_cap * sizeof(time_t));
+    if (!expires) return -1;
+    wheel->expires = expires;
+    uint32_t **head_of = realloc(wheel->head_of, new_cap * sizeof(uint32_t *));
+    if (!head_of) return -1;
+    wheel->head_of = head_of;
+
+    memset(wheel->head_of + wheel->cap, 0, (new_cap - wheel->cap) * sizeof(uint32_t *));
+    wheel->cap = new_cap;
+    return 0;
+}
+
+// Slot list a timer belongs to, given the current tick
+static uint32_t *slot_for(TimerWheel *wheel, time_t expires) {
+    time_t delta = expires - wheel->current;
+
+    if (delta <= 0) return &wheel->level0[(wheel->current + 1) & WHEEL_MASK];  // Overdue: next tick
+    if (delta < WHEEL_SLOTS) return &wheel->level0[expires & WHEEL_MASK];
+    if (delta < (time_t)WHEEL_SLOTS * WHEEL_SLOTS) return &wheel->level1[(expires >> WHEEL_BITS) & WHEEL_MASK];
+    // Beyond the horizon: park it in the last level 1 slot, it is re-placed on cascade
+    return &wheel->level1[((wheel->current >> WHEEL_BITS) + WHEEL_MASK) & WHEEL_MASK];
+}
+
+static void link_timer(TimerWheel *wheel, uint32_t id) {
+    uint32_t *head = slot_for(wheel, wheel->expires[id]);
+    wheel->prev[id] = TIMER_NONE;
+    wheel->next[id] = *head;
+    if (*head != TIMER_NONE) wheel->prev[*head] = id;
+    *head = id;
+    wheel->head_of[id] = head;
+}
+
+static void unlink_timer(TimerWheel *wheel, uint32_t id) {
+    if (wheel->prev[id] != TIMER_NONE) wheel->next[wheel->prev[id]] = wheel->next[id];
+    else *wheel->head_of[id] = wheel->next[id];
+    if (wheel->next[id] != TIMER_NONE) wheel->prev[wheel->next[id]] = wheel->prev[id];
+    wheel->head_of[id] = NULL;
+}
+
+int timer_wheel_add(TimerWheel *wheel, uint32_t id, time_t expires) {
+    if (reserve(wheel, id) < 0) return -1;
+
+    if (wheel->head_of[id]) unlink_timer(wheel, id);
+    else wheel->count++;
+
+    wheel->expires[id] = expires;
+    link_timer(wheel, id);
+    return 0;
+}
+
+void timer_wheel_remove(TimerWheel *wheel, uint32_t id) {
+    if (id >= wheel->cap || !wheel->head_of[id]) return;
+    unlink_timer(wheel, id);
+    wheel->count--;
+}
+
+void timer_wheel_advance(TimerWheel *wheel, time_t now, timer_callback fire, void *ctx) {
+    if (wheel->count == 0) {
+        if (now > wheel->current) wheel->current = now;
+        return;
+    }
+
+    while (wheel->current < now) {
+        wheel->current++;
+
+        // Every 64 ticks, spread the next level 1 slot over level 0
+        if ((wheel->current & WHEEL_MASK) == 0) {
+            uint32_t *head = &wheel->level1[(wheel->current >> WHEEL_BITS) & WHEEL_MASK];
+            uint32_t id = *head;
+            *head = TIMER_NONE;
+            while (id != TIMER_NONE) {
+                uint32_t next = wheel->next[id];
+                link_timer(wheel, id);
+                id = next;
+            }
+        }
+
+        // Fire the timers of this tick; the list is detached first so callbacks can re-arm
+        uint32_t *head = &wheel->level0[wheel->current & WHEEL_MASK];
+        uint32_t id = *head;
+        *head = TIMER_NONE;
+        while (id != TIMER_NONE) {
+            uint32_t next = wheel->next[id];
+            if (next != TIMER_NONE) wheel->prev[next] = TIMER_NONE;
+            wheel->head_of[id] = NULL;
+
+            if (wheel->expires[id] <= wheel->current) {
+                wheel->count--;
+                fire(id, ctx);
+            } else {
+                link_timer(wheel, id);
+            }
+            id = next;
+        }
+    }
+}
+
+int timer_wheel_timeout(const TimerWheel *wheel) {
+    if (wheel->count == 0) return -1;
+
+    // Wake up at the next second boundary
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    if (tv.tv_sec > wheel->current) return 0;   // A tick is already due
+    return 1000 - (int)(tv.tv_usec / 1000);
+}
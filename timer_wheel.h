@@ -0,0 +1,61 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)    // Slots per level (64)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define TIMER_NONE 0xFFFFFFFFu
+
+/*
+ * Two-level hierarchical timing wheel with 1 second ticks.
+ * Level 0 holds timers due in the next 64 s (one slot per second), level 1 timers due in the
+ * next 64 * 64 s (one slot per 64 s), which covers MAX_PLAYTIME comfortably; anything further
+ * away is parked in the last level 1 slot and re-placed when it is cascaded.
+ *
+ * Timers are identified by a small integer id (the game slot), and the links live in arrays
+ * indexed by that id, so adding and cancelling a timer never allocates per timer.
+ */
+typedef struct {
+    uint32_t level0[WHEEL_SLOTS];   // Head id of each slot list
+    uint32_t level1[WHEEL_SLOTS];
+    uint32_t *next, *prev;          // Doubly-linked slot lists, indexed by id
+    uint32_t **head_of;             // Head pointer of the list each id is on (NULL if not armed)
+    time_t *expires;                // Expiry time of each id
+    uint32_t cap;                   // Size of the per-id arrays
+    uint32_t count;                 // Armed timers
+    time_t current;                 // Last processed tick
+} TimerWheel;
+
+typedef void (*timer_callback)(uint32_t id, void *ctx);
+
+int timer_wheel_init(TimerWheel *wheel, time_t now);
+void timer_wheel_free(TimerWheel *wheel);
+
+/**
+ * Arm (or re-arm) the timer of an id to fire at the tick `expires`.
+ *
+ * @return 0 on success, -1 if out of memory
+ */
+int timer_wheel_add(TimerWheel *wheel, uint32_t id, time_t expires);
+
+/**
+ * Cancel the timer of an id (no-op if it is not armed).
+ */
+void timer_wheel_remove(TimerWheel *wheel, uint32_t id);
+
+/**
+ * Process every tick up to `now`, calling `fire` for each timer that expired.
+ * Must be called before arming timers after a sleep, so an idle wheel catches up with the clock.
+ * The callback may arm new timers; it must not cancel timers other than the one that fired.
+ */
+void timer_wheel_advance(TimerWheel *wheel, time_t now, timer_callback fire, void *ctx);
+
+/**
+ * Milliseconds until the next tick that needs processing (epoll_wait timeout), or -1 if idle.
+ */
+int timer_wheel_timeout(const TimerWheel *wheel);
+
+#endif
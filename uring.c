@@ -0,0 +1,209 @@
+/*
+ * uring.c
+ *
+ * io_uring through its three system calls. The submission and completion rings are shared
+ * with the kernel: the producer of each ring publishes its tail with a release store and the
+ * consumer its head, so filling SQEs and reaping CQEs never enters the kernel; only
+ * io_uring_enter does, once per submit-and-wait.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+static int sys_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+int uring_init(Uring *ring, unsigned entries, unsigned cq_entries) {
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = cq_entries;
+    ring->fd = sys_setup(entries, &params);
+    if (ring->fd < 0 && errno == EINVAL) {
+        // Older kernel: the task-run hints are optional
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = cq_entries;
+        ring->fd = sys_setup(entries, &params);
+    }
+    if (ring->fd < 0) return -1;
+
+    // Waiting with a timeout needs IORING_ENTER_EXT_ARG (5.11)
+    ring->features = params.features;
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(ring->fd);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+    ring->cq_ring_size = ring->sq_ring_size;     // One mapping holds both rings
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) goto fail;
+    ring->cq_ring = ring->sq_ring;
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        goto fail;
+    }
+
+    char *sq = ring->sq_ring, *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // SQE i always sits in array slot i
+    for (unsigned i = 0; i < params.sq_entries; i++) ring->sq_array[i] = i;
+    return 0;
+
+fail:
+    close(ring->fd);
+    return -1;
+}
+
+void uring_free(Uring *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+struct io_uring_sqe *uring_get_sqe(Uring *ring) {
+    unsigned tail = *ring->sq_tail + ring->sq_pending;
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    if (tail - head > *ring->sq_mask) {
+        if (uring_submit_and_wait(ring, 0, 0) < 0) return NULL;
+        tail = *ring->sq_tail + ring->sq_pending;
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head > *ring->sq_mask) return NULL;
+    }
+    struct io_uring_sqe *sqe = &ring->sqes[tail & *ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_pending++;
+    return sqe;
+}
+
+int uring_submit_and_wait(Uring *ring, unsigned wait_nr, int timeout_ms) {
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    unsigned submit = ring->sq_pending;
+
+    // Hand the filled SQEs to the kernel
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + submit, __ATOMIC_RELEASE);
+    ring->sq_pending = 0;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+
+    while (1) {
+        unsigned flags = IORING_ENTER_EXT_ARG | (wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+        int n = sys_enter(ring->fd, submit, wait_nr, flags, &arg, sizeof(arg));
+        if (n >= 0) {
+            if ((unsigned)n >= submit) return 0;
+            submit -= n;    // Kernel short of resources: retry the rest
+            continue;
+        }
+        if (errno == ETIME) return 0;
+        if (errno == EINTR && submit == 0) return 0;
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return -1;
+        if (submit == 0) return 0;
+    }
+}
+
+struct io_uring_cqe *uring_peek_cqe(Uring *ring) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+void uring_cqe_seen(Uring *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int uring_register_files(Uring *ring, const int *fds, unsigned n) {
+    return sys_register(ring->fd, IORING_REGISTER_FILES, fds, n);
+}
+
+int uring_buffers_init(Uring *ring, UringBuffers *buffers, uint16_t group, unsigned entries, unsigned buf_size) {
+    struct io_uring_buf_reg reg;
+    size_t ring_size = entries * sizeof(struct io_uring_buf);
+
+    memset(buffers, 0, sizeof(*buffers));
+    buffers->entries = entries;
+    buffers->buf_size = buf_size;
+    buffers->group = group;
+
+    // The ring shared with the kernel must be page aligned
+    buffers->br = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers->br == MAP_FAILED) return -1;
+    buffers->buffers = malloc((size_t)entries * buf_size);
+    if (!buffers->buffers) {
+        munmap(buffers->br, ring_size);
+        return -1;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)buffers->br;
+    reg.ring_entries = entries;
+    reg.bgid = group;
+    if (sys_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        uring_buffers_free(buffers);
+        return -1;
+    }
+
+    for (unsigned i = 0; i < entries; i++) uring_buffers_recycle(buffers, i);
+    uring_buffers_publish(buffers);
+    return 0;
+}
+
+void uring_buffers_free(UringBuffers *buffers) {
+    munmap(buffers->br, buffers->entries * sizeof(struct io_uring_buf));
+    free(buffers->buffers);
+}
+
+void uring_buffers_recycle(UringBuffers *buffers, uint16_t id) {
+    struct io_uring_buf *buf = &buffers->br->bufs[buffers->tail & (buffers->entries - 1)];
+    buf->addr = (uint64_t)(uintptr_t)uring_buffer(buffers, id);
+    buf->len = buffers->buf_size;
+    buf->bid = id;
+    buffers->tail++;
+}
+
+void uring_buffers_publish(UringBuffers *buffers) {
+    __atomic_store_n(&buffers->br->tail, buffers->tail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,91 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+/*
+ * Minimal io_uring wrapper on the raw system calls (no liburing): ring setup and teardown,
+ * SQE allocation, submit-and-wait with a timeout, CQE iteration, registered files and
+ * provided buffer rings. Each ring is used by a single thread.
+ */
+typedef struct {
+    int fd;
+    unsigned features;
+
+    // Submission queue
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_pending;            // SQEs filled in but not yet handed to the kernel
+
+    // Completion queue
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+} Uring;
+
+// Provided buffer ring: the kernel picks a free buffer for each received datagram
+typedef struct {
+    struct io_uring_buf_ring *br;
+    char *buffers;
+    unsigned entries;               // Power of two
+    unsigned buf_size;
+    uint16_t group;                 // Buffer group id (sqe->buf_group)
+    uint16_t tail;                  // Local tail, published by uring_buffers_publish
+} UringBuffers;
+
+/**
+ * Create a ring with `entries` SQEs and `cq_entries` CQEs.
+ *
+ * @return 0 on success, -1 (errno set) if io_uring is missing or lacks the needed features
+ */
+int uring_init(Uring *ring, unsigned entries, unsigned cq_entries);
+void uring_free(Uring *ring);
+
+/**
+ * Next free SQE (zeroed), submitting the pending ones first if the queue is full.
+ *
+ * @return the SQE, or NULL if the queue is still full
+ */
+struct io_uring_sqe *uring_get_sqe(Uring *ring);
+
+/**
+ * Submit the pending SQEs and wait until `wait_nr` CQEs are ready or `timeout_ms` elapsed
+ * (-1 waits forever) — a single system call.
+ *
+ * @return 0 on success (or timeout), -1 on error
+ */
+int uring_submit_and_wait(Uring *ring, unsigned wait_nr, int timeout_ms);
+
+/**
+ * Oldest unconsumed CQE, or NULL; release it with uring_cqe_seen.
+ */
+struct io_uring_cqe *uring_peek_cqe(Uring *ring);
+void uring_cqe_seen(Uring *ring);
+
+/**
+ * Register files, addressed afterwards by index with IOSQE_FIXED_FILE.
+ */
+int uring_register_files(Uring *ring, const int *fds, unsigned n);
+
+/**
+ * Allocate `entries` buffers of `buf_size` bytes and register them as buffer group `group`.
+ */
+int uring_buffers_init(Uring *ring, UringBuffers *buffers, uint16_t group, unsigned entries, unsigned buf_size);
+void uring_buffers_free(UringBuffers *buffers);
+
+// Address of a buffer
+static inline char *uring_buffer(const UringBuffers *buffers, uint16_t id) {
+    return buffers->buffers + (size_t)id * buffers->buf_size;
+}
+
+/**
+ * Give a buffer back to the kernel (visible after uring_buffers_publish).
+ */
+void uring_buffers_recycle(UringBuffers *buffers, uint16_t id);
+void uring_buffers_publish(UringBuffers *buffers);
+
+#endif
@@ -0,0 +1,305 @@
+/*
+ * vlog.c
+ *
+ * Per-thread rings of binary log records, formatted off the request path by one background
+ * thread. Producers only walk the conversion specifications of the format to pick up the
+ * arguments; all the printf work and the I/O happen in the background.
+ */
+
+#define _GNU_SOURCE     // fwrite_unlocked, fputs_unlocked
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vlog.h"
+
+#define VLOG_TEXT (128 - sizeof(const char *) - VLOG_MAX_ARGS * sizeof(uint64_t) - 2)
+
+// One message: 128 bytes
+typedef struct {
+    const char *fmt;                // Format string (identifies the message)
+    uint64_t args[VLOG_MAX_ARGS];   // Integers, double bits, or offsets of strings in `text`
+    uint8_t n_args;
+    uint8_t text_len;
+    char text[VLOG_TEXT];           // String arguments, NUL-terminated
+} VlogRecord;
+
+typedef struct {
+    _Atomic uint64_t head;          // Written by the producer thread
+    _Atomic uint64_t dropped;       // Written by the producer thread
+    char pad0[64 - 2 * sizeof(uint64_t)];
+    _Atomic uint64_t tail;          // Written by the background thread
+    char pad1[64 - sizeof(uint64_t)];
+    VlogRecord records[VLOG_RING_SIZE];
+} VlogRing;
+
+static VlogRing *rings[VLOG_MAX_THREADS];
+static atomic_int n_rings = 0;
+static pthread_mutex_t register_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic uint64_t unregistered_drops = 0;    // Threads beyond VLOG_MAX_THREADS
+
+static __thread VlogRing *thread_ring;
+
+static pthread_t flusher;
+static FILE *vlog_out;
+static atomic_int running = 0;
+
+// Ring of the calling thread, created on its first message
+static VlogRing *own_ring(void) {
+    if (thread_ring) return thread_ring;
+
+    VlogRing *ring = calloc(1, sizeof(VlogRing));
+    if (!ring) return NULL;
+    pthread_mutex_lock(&register_mutex);
+    int n = atomic_load(&n_rings);
+    if (n < VLOG_MAX_THREADS) {
+        rings[n] = ring;
+        atomic_store(&n_rings, n + 1);
+        thread_ring = ring;
+    }
+    pthread_mutex_unlock(&register_mutex);
+    if (!thread_ring) free(ring);
+    return thread_ring;
+}
+
+/*
+ * Next conversion specification of a format (after `*p`), shared by the producer and the
+ * formatter so both agree on the arguments. Returns the conversion character (0 at the end of
+ * the format) and leaves `*p` just past it, `*start` at its '%'.
+ */
+static char next_spec(const char **p, const char **start, int *stars, int *longs) {
+    const char *s = *p;
+
+    while (1) {
+        s = strchr(s, '%');
+        if (!s) {
+            *p = *p + strlen(*p);
+            return 0;
+        }
+        if (s[1] == '%') {
+            s += 2;
+            continue;
+        }
+        break;
+    }
+
+    *start = s++;
+    *stars = *longs = 0;
+    while (*s && strchr("-+ #0", *s)) s++;
+    while (*s == '*' || (*s >= '0' && *s <= '9')) *stars += *s++ == '*';
+    if (*s == '.') {
+        s++;
+        while (*s == '*' || (*s >= '0' && *s <= '9')) *stars += *s++ == '*';
+    }
+    while (*s && strchr("hlzjt", *s)) *longs += *s++ != 'h';
+    char conv = *s;
+    if (conv) s++;
+    *p = s;
+    return conv;
+}
+
+// Argument types of a format ('i' int, 'l' long, 'd' double, 'p' pointer, 's' string)
+static const char *signature(const char *fmt) {
+    static __thread struct {
+        const char *fmt;
+        char types[VLOG_MAX_ARGS + 1];
+    } cache[VLOG_SIGNATURES];
+
+    unsigned slot = ((uintptr_t)fmt >> 3) & (VLOG_SIGNATURES - 1);
+    if (cache[slot].fmt == fmt) return cache[slot].types;
+
+    const char *p = fmt, *start;
+    int stars, longs, n = 0;
+    char conv;
+    while ((conv = next_spec(&p, &start, &stars, &longs)) != 0 && n < VLOG_MAX_ARGS) {
+        for (int i = 0; i < stars && n < VLOG_MAX_ARGS; i++) cache[slot].types[n++] = 'i';
+        if (n == VLOG_MAX_ARGS) break;
+
+        if (conv == 's' || conv == 'p') cache[slot].types[n++] = conv;
+        else if (conv == 'f' || conv == 'g' || conv == 'e') cache[slot].types[n++] = 'd';
+        else cache[slot].types[n++] = longs ? 'l' : 'i';
+    }
+    cache[slot].types[n] = '\0';
+    cache[slot].fmt = fmt;
+    return cache[slot].types;
+}
+
+void vlog(const char *fmt, ...) {
+    VlogRing *ring = own_ring();
+    if (!ring) {
+        atomic_fetch_add_explicit(&unregistered_drops, 1, memory_order_relaxed);
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= VLOG_RING_SIZE) {
+        atomic_store_explicit(&ring->dropped, atomic_load_explicit(&ring->dropped, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+        return;
+    }
+
+    VlogRecord *record = &ring->records[head & (VLOG_RING_SIZE - 1)];
+    const char *types = signature(fmt);
+    size_t text = 0;
+    int n = 0;
+    va_list ap;
+
+    record->fmt = fmt;
+    va_start(ap, fmt);
+    for (; types[n]; n++) {
+        if (types[n] == 's') {
+            const char *s = va_arg(ap, const char *);
+            size_t len = s ? strlen(s) : 0;
+            if (text + len + 1 > VLOG_TEXT) len = text < VLOG_TEXT ? VLOG_TEXT - text - 1 : 0;
+            record->args[n] = text;
+            if (text < VLOG_TEXT) {
+                memcpy(record->text + text, s ? s : "", len);
+                record->text[text + len] = '\0';
+                text += len + 1;
+            }
+        } else if (types[n] == 'd') {
+            double d = va_arg(ap, double);
+            memcpy(&record->args[n], &d, sizeof(d));
+        } else if (types[n] == 'p') {
+            record->args[n] = (uint64_t)(uintptr_t)va_arg(ap, void *);
+        } else if (types[n] == 'l') {
+            record->args[n] = (uint64_t)va_arg(ap, long);
+        } else {
+            record->args[n] = (uint64_t)va_arg(ap, int);
+        }
+    }
+    va_end(ap);
+    record->n_args = n;
+    record->text_len = text < VLOG_TEXT ? text : VLOG_TEXT;
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Format one conversion with its (up to two) '*' arguments
+#define EMIT(out, spec, stars, star, value) do { \
+        if ((stars) == 0) fprintf(out, spec, value); \
+        else if ((stars) == 1) fprintf(out, spec, star[0], value); \
+        else fprintf(out, spec, star[0], star[1], value); \
+    } while (0)
+
+// Copy the text between conversions, turning %% into %
+static void put_literal(FILE *out, const char *from, const char *to) {
+    while (from < to) {
+        const char *percent = memchr(from, '%', to - from);
+        const char *end = percent ? percent + 1 : to;
+        fwrite_unlocked(from, 1, end - from, out);
+        from = percent ? percent + 2 : to;
+    }
+}
+
+static void format_record(FILE *out, const VlogRecord *record) {
+    const char *p = record->fmt, *start, *literal = record->fmt;
+    int stars, longs, n = 0, star[2] = {0, 0};
+    char conv, spec[32];
+
+    while ((conv = next_spec(&p, &start, &stars, &longs)) != 0) {
+        put_literal(out, literal, start);
+        literal = p;
+
+        size_t len = p - start < (long)sizeof(spec) - 1 ? (size_t)(p - start) : sizeof(spec) - 1;
+        memcpy(spec, start, len);
+        spec[len] = '\0';
+        if (stars > 2 || n + stars >= record->n_args) {
+            fputs(spec, out);   // Arguments beyond VLOG_MAX_ARGS were not recorded
+            continue;
+        }
+        for (int i = 0; i < stars; i++) star[i] = (int)record->args[n++];
+
+        uint64_t arg = record->args[n++];
+        if (conv == 's' && p - start == 2) {
+            fputs_unlocked(arg < record->text_len ? record->text + arg : "", out);
+        } else if (conv == 's') {
+            EMIT(out, spec, stars, star, arg < record->text_len ? record->text + arg : "");
+        } else if (conv == 'f' || conv == 'g' || conv == 'e') {
+            double d;
+            memcpy(&d, &arg, sizeof(d));
+            EMIT(out, spec, stars, star, d);
+        } else if (conv == 'p') {
+            EMIT(out, spec, stars, star, (void *)(uintptr_t)arg);
+        } else if (longs) {
+            EMIT(out, spec, stars, star, (long)arg);
+        } else {
+            EMIT(out, spec, stars, star, (int)arg);
+        }
+    }
+    put_literal(out, literal, literal + strlen(literal));
+}
+
+// Format and write every queued record; returns the number written
+static long drain(void) {
+    static uint64_t reported = 0;
+    long written = 0;
+    int n = atomic_load(&n_rings);
+
+    flockfile(vlog_out);
+    for (int i = 0; i < n; i++) {
+        VlogRing *ring = rings[i];
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; tail++, written++) {
+            format_record(vlog_out, &ring->records[tail & (VLOG_RING_SIZE - 1)]);
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+
+    uint64_t dropped = vlog_dropped();
+    if (dropped != reported) {
+        fprintf(vlog_out, "[vlog] %lu messages dropped (ring full)\n", (unsigned long)(dropped - reported));
+        reported = dropped;
+    }
+    if (written) fflush_unlocked(vlog_out);
+    funlockfile(vlog_out);
+    return written;
+}
+
+static void *flush_loop(void *arg) {
+    (void)arg;
+    struct timespec pause = {0, VLOG_FLUSH_MS * 1000000L};
+
+    while (atomic_load(&running)) {
+        drain();
+        nanosleep(&pause, NULL);
+    }
+    drain();
+    return NULL;
+}
+
+int vlog_start(FILE *out) {
+    vlog_out = out;
+    atomic_store(&running, 1);
+
+    // Signals are left to the threads of the caller
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int error = pthread_create(&flusher, NULL, flush_loop, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (error) {
+        atomic_store(&running, 0);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+void vlog_stop(void) {
+    if (!atomic_exchange(&running, 0)) return;
+    pthread_join(flusher, NULL);
+}
+
+uint64_t vlog_dropped(void) {
+    uint64_t total = atomic_load_explicit(&unregistered_drops, memory_order_relaxed);
+    int n = atomic_load(&n_rings);
+    for (int i = 0; i < n; i++) total += atomic_load_explicit(&rings[i]->dropped, memory_order_relaxed);
+    return total;
+}
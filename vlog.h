@@ -0,0 +1,46 @@
+#ifndef VLOG_H
+#define VLOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define VLOG_RING_SIZE 4096     // Records buffered per thread (power of two)
+#define VLOG_MAX_THREADS 128    // Threads that can log (others have their messages dropped)
+#define VLOG_MAX_ARGS 6
+#define VLOG_SIGNATURES 64      // Parsed formats cached per thread (power of two)
+#define VLOG_FLUSH_MS 10        // How often the background thread formats and writes
+
+/*
+ * Asynchronous diagnostics log for -v. A message is a binary record: the address of its
+ * format string (a literal, so it identifies the message) plus the raw arguments, with string
+ * arguments copied inline. Each thread appends to its own lock-free single-producer ring;
+ * a background thread drains the rings, formats the records and writes them out, so logging
+ * costs a request neither a printf nor a write(). Messages that find their ring full are
+ * dropped and counted. Messages of one thread stay in order; threads are not interleaved in
+ * time order.
+ */
+
+/**
+ * Start the background thread writing to `out`.
+ *
+ * @return 0 on success, -1 on error
+ */
+int vlog_start(FILE *out);
+
+/**
+ * Write everything still queued and stop the background thread.
+ */
+void vlog_stop(void);
+
+/**
+ * Queue a message. Supports the printf conversions d i u x X o c s f g e p, with h/l/ll/z
+ * length modifiers and '*' width or precision; long strings are truncated.
+ */
+void vlog(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * Messages dropped so far because their ring was full.
+ */
+uint64_t vlog_dropped(void);
+
+#endif
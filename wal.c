@@ -0,0 +1,300 @@
+/*
+ * wal.c
+ *
+ * Segmented, append-only binary write-ahead log of game events. Each UDP worker appends
+ * fixed-size records (START, TRIAL, FINISH) to its own log instead of touching the
+ * per-player text files; the materializer thread tails the logs and produces those files
+ * in the background, deleting segments once they have been applied and a snapshot of the
+ * in-memory state covers them (see snapshot.c).
+ *
+ * Segments are named WAL/shard<N>_<segment>.log and never exceed WAL_SEGMENT_SIZE. Segment
+ * numbers continue from one run to the next, so log positions only ever grow.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "wal.h"
+
+// FNV-1a over the record, skipping the checksum field itself
+static uint32_t record_checksum(const WalRecord *record) {
+    const unsigned char *p = (const unsigned char *)record + sizeof(record->checksum);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(WalRecord) - sizeof(record->checksum); i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+void wal_segment_path(char *path, size_t size, int shard, uint32_t segment) {
+    snprintf(path, size, "%s/shard%d_%08u.log", WAL_DIR, shard, segment);
+}
+
+static int open_segment(Wal *wal) {
+    char path[64];
+    wal_segment_path(path, sizeof(path), wal->shard, wal->segment);
+    wal->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666);
+    if (wal->fd < 0) {
+        perror("Failed to open WAL segment");
+        return -1;
+    }
+    wal->offset = 0;
+    return 0;
+}
+
+static void publish(Wal *wal) {
+    atomic_store_explicit(&wal->published, ((uint64_t)wal->segment << 32) | (uint64_t)wal->offset, memory_order_release);
+}
+
+int wal_open(Wal *wal, int shard, uint32_t segment) {
+    memset(wal, 0, sizeof(*wal));
+    wal->shard = shard;
+    wal->segment = segment;
+    atomic_store(&wal->applied, WAL_POSITION(segment, 0));
+    atomic_store(&wal->retain, segment);
+    wal->buf_cap = 64 * sizeof(WalRecord);
+    wal->buf = malloc(wal->buf_cap);
+    if (!wal->buf) return -1;
+    clock_gettime(CLOCK_MONOTONIC, &wal->last_sync);
+    if (open_segment(wal) < 0) return -1;
+    publish(wal);
+    return 0;
+}
+
+// Write the whole buffer to the current segment
+static ssize_t write_buffer(Wal *wal) {
+    size_t done = 0;
+    while (done < wal->buf_len) {
+        ssize_t n = write(wal->fd, wal->buf + done, wal->buf_len - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Failed to write WAL");
+            return -1;
+        }
+        done += n;
+    }
+    wal->offset += done;
+    wal->buf_len = 0;
+    wal->dirty = 1;
+    return done;
+}
+
+// Seal the current segment (durably) and continue in the next one
+static int rollover(Wal *wal) {
+    if (write_buffer(wal) < 0) return -1;
+    fdatasync(wal->fd);
+    close(wal->fd);
+    wal->dirty = 0;
+    wal->segment++;
+    if (open_segment(wal) < 0) return -1;
+    publish(wal);   // The reader moves on once the new segment is visible
+    return 0;
+}
+
+int wal_append(Wal *wal, WalRecord *record) {
+    record->checksum = record_checksum(record);
+
+    // Records never straddle two segments
+    if (wal->offset + (off_t)(wal->buf_len + sizeof(WalRecord)) > WAL_SEGMENT_SIZE && rollover(wal) < 0)
+        return -1;
+
+    if (wal->buf_len + sizeof(WalRecord) > wal->buf_cap) {
+        char *grown = realloc(wal->buf, wal->buf_cap * 2);
+        if (!grown) return -1;
+        wal->buf = grown;
+        wal->buf_cap *= 2;
+    }
+    memcpy(wal->buf + wal->buf_len, record, sizeof(WalRecord));
+    wal->buf_len += sizeof(WalRecord);
+    return 0;
+}
+
+ssize_t wal_flush(Wal *wal) {
+    if (wal->buf_len == 0) return 0;
+    ssize_t n = write_buffer(wal);
+    if (n > 0) publish(wal);
+    return n;
+}
+
+// Milliseconds elapsed since the last sync
+static long since_sync_ms(const Wal *wal) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - wal->last_sync.tv_sec) * 1000 + (now.tv_nsec - wal->last_sync.tv_nsec) / 1000000;
+}
+
+void wal_sync(Wal *wal, int interval_ms) {
+    if (!wal->dirty || since_sync_ms(wal) < interval_ms) return;
+    if (fdatasync(wal->fd) < 0) perror("Failed to sync WAL");
+    clock_gettime(CLOCK_MONOTONIC, &wal->last_sync);
+    wal->dirty = 0;
+}
+
+int wal_sync_timeout(const Wal *wal, int interval_ms) {
+    if (!wal->dirty) return -1;
+    long left = interval_ms - since_sync_ms(wal);
+    return left > 0 ? (int)left : 0;
+}
+
+void wal_close(Wal *wal) {
+    wal_flush(wal);
+    wal_sync(wal, 0);
+    close(wal->fd);
+    free(wal->buf);
+    wal->buf = NULL;
+}
+
+void wal_reader_init(WalReader *reader, int shard, uint32_t segment) {
+    reader->shard = shard;
+    reader->fd = -1;
+    reader->segment = segment;
+    reader->offset = 0;
+    reader->oldest = segment;
+}
+
+// Delete the segments that are applied and that no snapshot needs anymore
+static void prune(WalReader *reader, const Wal *wal) {
+    uint32_t keep = atomic_load_explicit(&wal->retain, memory_order_acquire);
+    if (keep > reader->segment) keep = reader->segment;
+    while (reader->oldest < keep) {
+        char path[64];
+        wal_segment_path(path, sizeof(path), reader->shard, reader->oldest++);
+        unlink(path);
+    }
+}
+
+int wal_read(WalReader *reader, Wal *wal, WalRecord *record) {
+    // Everything read so far has been applied
+    atomic_store_explicit(&wal->applied, WAL_POSITION(reader->segment, reader->offset), memory_order_release);
+    prune(reader, wal);
+
+    while (1) {
+        uint64_t published = atomic_load_explicit(&wal->published, memory_order_acquire);
+        uint32_t segment = WAL_SEGMENT_OF(published);
+        off_t end = (off_t)(published & 0xFFFFFFFFu);
+
+        if (reader->fd < 0) {
+            char path[64];
+            wal_segment_path(path, sizeof(path), reader->shard, reader->segment);
+            if ((reader->fd = open(path, O_RDONLY)) < 0) return 0;
+            reader->offset = 0;
+        }
+
+        // Records of an older segment are complete up to its end of file
+        if (reader->segment == segment && reader->offset + (off_t)sizeof(WalRecord) > end) return 0;
+
+        ssize_t n = pread(reader->fd, record, sizeof(WalRecord), reader->offset);
+        if (n == (ssize_t)sizeof(WalRecord)) {
+            reader->offset += n;
+            return 1;
+        }
+
+        if (reader->segment == segment) return 0;
+
+        // Sealed segment fully applied: move on (it is deleted once no snapshot needs it)
+        close(reader->fd);
+        reader->fd = -1;
+        reader->segment++;
+        reader->offset = 0;
+        atomic_store_explicit(&wal->applied, WAL_POSITION(reader->segment, 0), memory_order_release);
+        prune(reader, wal);
+    }
+}
+
+void wal_reader_close(WalReader *reader) {
+    if (reader->fd >= 0) close(reader->fd);
+    reader->fd = -1;
+}
+
+// Segment left over by a previous run
+typedef struct {
+    int shard;
+    uint32_t segment;
+    char name[300];
+} Leftover;
+
+static int compare_leftovers(const void *a, const void *b) {
+    const Leftover *x = a, *y = b;
+    if (x->shard != y->shard) return x->shard < y->shard ? -1 : 1;
+    if (x->segment != y->segment) return x->segment < y->segment ? -1 : 1;
+    return 0;
+}
+
+// Segments in WAL_DIR, sorted by shard and segment number
+static Leftover *list_segments(size_t *count) {
+    DIR *dir = opendir(WAL_DIR);
+    struct dirent *entry;
+    Leftover *leftovers = NULL;
+    size_t n_leftovers = 0, cap = 0;
+
+    *count = 0;
+    if (!dir) return NULL;
+    while ((entry = readdir(dir)) != NULL) {
+        Leftover item;
+        if (sscanf(entry->d_name, "shard%d_%u.log", &item.shard, &item.segment) != 2) continue;
+        if (n_leftovers == cap) {
+            cap = cap ? cap * 2 : 16;
+            Leftover *grown = realloc(leftovers, cap * sizeof(Leftover));
+            if (!grown) break;
+            leftovers = grown;
+        }
+        snprintf(item.name, sizeof(item.name), "%s/%s", WAL_DIR, entry->d_name);
+        leftovers[n_leftovers++] = item;
+    }
+    closedir(dir);
+
+    if (n_leftovers) qsort(leftovers, n_leftovers, sizeof(Leftover), compare_leftovers);
+    *count = n_leftovers;
+    return leftovers;
+}
+
+long wal_replay(wal_apply apply, const uint64_t *from, uint32_t below, uint32_t *next_segment) {
+    size_t n_leftovers;
+    Leftover *leftovers = list_segments(&n_leftovers);
+    long replayed = 0;
+
+    if (next_segment) *next_segment = 0;
+    for (size_t i = 0; i < n_leftovers; i++) {
+        Leftover *leftover = &leftovers[i];
+        uint32_t offset = 0;
+
+        if (next_segment && leftover->segment >= *next_segment) *next_segment = leftover->segment + 1;
+        if (leftover->segment >= below || leftover->shard < 0 || leftover->shard >= WAL_MAX_SHARDS) continue;
+        if (from) {
+            uint32_t start = WAL_SEGMENT_OF(from[leftover->shard]);
+            if (leftover->segment < start) continue;
+            if (leftover->segment == start) offset = (uint32_t)from[leftover->shard];
+        }
+
+        FILE *file = fopen(leftover->name, "rb");
+        WalRecord record;
+        if (!file) continue;
+        if (offset && fseek(file, offset, SEEK_SET) < 0) {
+            fclose(file);
+            continue;
+        }
+        while (fread(&record, sizeof(record), 1, file) == 1 && record.checksum == record_checksum(&record)) {
+            apply(&record, leftover->shard, WAL_POSITION(leftover->segment, offset));
+            offset += sizeof(record);
+            replayed++;
+        }
+        fclose(file);
+    }
+    free(leftovers);
+    return replayed;
+}
+
+void wal_discard(uint32_t segment) {
+    size_t n_leftovers;
+    Leftover *leftovers = list_segments(&n_leftovers);
+
+    for (size_t i = 0; i < n_leftovers; i++) {
+        if (leftovers[i].segment < segment) unlink(leftovers[i].name);
+    }
+    free(leftovers);
+}
@@ -0,0 +1,146 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define WAL_DIR "WAL"
+#define WAL_SEGMENT_SIZE (4 << 20)      // Segment rollover size (bytes)
+#define WAL_FSYNC_INTERVAL 10           // Default group commit interval (ms)
+#define WAL_MAX_SHARDS 64               // MAX_WORKERS
+
+// Position in a shard's log: segment number in the high half, byte offset in the low half
+#define WAL_POSITION(segment, offset) (((uint64_t)(segment) << 32) | (uint64_t)(offset))
+#define WAL_SEGMENT_OF(position) ((uint32_t)((position) >> 32))
+
+// Record types
+enum {
+    WAL_START = 1,      // SNG/DBG: a game was created
+    WAL_TRIAL,          // TRY: a trial was scored
+    WAL_FINISH          // Game ended (W, F, Q or T)
+};
+
+// Fixed-size binary log record (one per persisted event)
+typedef struct {
+    uint32_t checksum;      // FNV-1a of the rest of the record (detects torn writes)
+    uint8_t type;           // WAL_START, WAL_TRIAL or WAL_FINISH
+    char mode;              // START/FINISH: 'P' (PLAY) or 'D' (DEBUG)
+    char end_code;          // FINISH: 'W', 'F', 'Q' or 'T'
+    uint8_t trials;         // TRIAL: number of this trial; FINISH: trials made
+    uint8_t nB, nW;         // TRIAL: feedback
+    char plid[7];           // Player ID
+    char code[7];           // START/FINISH: secret key; TRIAL: guess (4 to 6 colours)
+    int32_t max_playtime;   // START/FINISH: maximum playtime (s)
+    int32_t elapsed;        // TRIAL: seconds since start; FINISH: game duration
+    int64_t time;           // START/TRIAL: start time of the game; FINISH: end time
+} WalRecord;
+
+/*
+ * Write side of one shard's log, owned by the log writer thread.
+ * Records are buffered in memory, written with one write() per flush, and made durable with
+ * one fdatasync() per group commit interval. The position of the last written byte is
+ * published (segment << 32 | offset) for the materializer thread, which publishes back how far
+ * it has applied the log. A segment is deleted once it is applied and older than `retain`, the
+ * first segment the latest snapshot still needs (set by the main thread).
+ */
+typedef struct {
+    int shard;
+    int fd;                         // Current segment
+    uint32_t segment;
+    off_t offset;                   // Bytes written to the current segment
+    char *buf;                      // Records not yet written
+    size_t buf_len, buf_cap;
+    int dirty;                      // Written but not yet fsynced
+    struct timespec last_sync;
+    _Atomic uint64_t published;     // Last written position
+    _Atomic uint64_t applied;       // Position up to which the materializer applied the records
+    _Atomic uint32_t retain;        // Oldest segment still needed by the latest snapshot
+} Wal;
+
+// Read side of one shard's log, owned by the materializer
+typedef struct {
+    int shard;
+    int fd;                         // Segment being read (-1 if not opened yet)
+    uint32_t segment;
+    off_t offset;                   // Bytes consumed in that segment
+    uint32_t oldest;                // Oldest segment not deleted yet
+} WalReader;
+
+// Called by wal_replay for every record, with its shard and its position in the shard's log
+typedef void (*wal_apply)(const WalRecord *record, int shard, uint64_t position);
+
+void wal_segment_path(char *path, size_t size, int shard, uint32_t segment);
+
+/**
+ * Start a fresh log for a shard at `segment`. Segment numbers keep growing across runs (see
+ * wal_replay), so a position saved by a snapshot stays comparable with later records.
+ *
+ * @return 0 on success, -1 on error
+ */
+int wal_open(Wal *wal, int shard, uint32_t segment);
+
+/**
+ * Buffer a record (its checksum is filled in here). No I/O happens until wal_flush.
+ */
+int wal_append(Wal *wal, WalRecord *record);
+
+/**
+ * Write the buffered records to the current segment and publish the new position.
+ *
+ * @return number of bytes written, 0 if nothing was pending, -1 on error
+ */
+ssize_t wal_flush(Wal *wal);
+
+/**
+ * Group commit: fdatasync the segment if records were written and `interval_ms` has elapsed
+ * since the last sync (0 syncs on every call).
+ */
+void wal_sync(Wal *wal, int interval_ms);
+
+/**
+ * Milliseconds until wal_sync has work to do, or -1 if everything is durable.
+ */
+int wal_sync_timeout(const Wal *wal, int interval_ms);
+
+/**
+ * Write and fsync everything, then close the segment.
+ */
+void wal_close(Wal *wal);
+
+/**
+ * Start reading a shard's log at the first segment of this run.
+ */
+void wal_reader_init(WalReader *reader, int shard, uint32_t segment);
+
+/**
+ * Read the next record published by a shard's writer. Calling it again means the previous
+ * record has been applied. Segments both applied and released by the snapshots are deleted.
+ *
+ * @return 1 if a record was read, 0 if the reader has caught up
+ */
+int wal_read(WalReader *reader, Wal *wal, WalRecord *record);
+
+/**
+ * Stop reading a shard's log after a clean shutdown. Segments that the latest snapshot still
+ * needs are left for wal_discard.
+ */
+void wal_reader_close(WalReader *reader);
+
+/**
+ * Apply the records left in WAL_DIR by a previous run (segment order, per shard), from the
+ * position `from[shard]` (WAL_MAX_SHARDS entries; NULL for every record) and only in segments
+ * numbered below `below`. A torn record ends its segment. The segments are kept until wal_discard.
+ *
+ * @param next_segment if not NULL, receives the number after the last segment found (0 if none)
+ * @return number of records replayed
+ */
+long wal_replay(wal_apply apply, const uint64_t *from, uint32_t below, uint32_t *next_segment);
+
+/**
+ * Delete every segment of every shard numbered below `segment`.
+ */
+void wal_discard(uint32_t segment);
+
+#endif